@@ -110,13 +110,14 @@ public:
     typedef Data DataType;
 
     BinaryHeap( size_t maxID )
-    : nodeIndex( maxID ) {
+    : settledNodes( 0 ), nodeIndex( maxID ) {
         Clear();
     }
 
     void Clear() {
         heap.resize( 1 );
         insertedNodes.clear();
+        settledNodes = 0;
         heap[0].weight = std::numeric_limits< Weight >::min();
         nodeIndex.Clear();
     }
@@ -125,6 +126,16 @@ public:
         return static_cast<Key>( heap.size() - 1 );
     }
 
+    //nodes inserted since the last Clear()
+    Key NumberOfInsertedNodes() const {
+        return static_cast<Key>( insertedNodes.size() );
+    }
+
+    //nodes taken out by DeleteMin() since the last Clear()
+    Key NumberOfSettledNodes() const {
+        return settledNodes;
+    }
+
     void Insert( NodeID node, Weight weight, const Data &data ) {
         HeapElement element;
         element.index = static_cast<NodeID>(insertedNodes.size());
@@ -173,6 +184,7 @@ public:
         if ( heap.size() > 1 )
             Downheap( 1 );
         insertedNodes[removedIndex].key = 0;
+        ++settledNodes;
         CheckHeap();
         return insertedNodes[removedIndex].node;
     }
@@ -216,6 +228,7 @@ private:
     };
 
     std::vector< HeapNode > insertedNodes;
+    Key settledNodes;
     std::vector< HeapElement > heap;
     IndexStorage nodeIndex;
 
@@ -0,0 +1,248 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef COMPRESSEDEDGERECORDS_H_
+#define COMPRESSEDEDGERECORDS_H_
+
+#include "Coordinate.h"
+#include "TurnInstructions.h"
+#include "../Util/MemoryPlacement.h"
+#include "../Util/OSRMException.h"
+#include "../Util/SimpleLogger.h"
+
+#include <boost/assert.hpp>
+#include <boost/integer.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+//records per block, a lookup decodes exactly one entry of its block
+const static uint32_t COMPRESSED_EDGE_RECORD_BLOCK_SIZE = 64;
+
+// Compact, random access copy of the edge records. The via coordinates are
+// stored per block of records as offsets to the block's minimal coordinate,
+// with as many bits as the block's extent needs. Name ids and turn
+// instructions follow each coordinate with a fixed number of bits. Any field
+// of a record is decoded in constant time from its block header and the
+// adjacent words that hold the record.
+
+class CompressedEdgeRecords : boost::noncopyable {
+public:
+    //RecordT provides via_coordinate, name_id and turn_instruction
+    template<class RecordT>
+    explicit CompressedEdgeRecords(const std::vector<RecordT> & records) :
+        m_number_of_records(records.size()),
+        m_name_bits(0),
+        m_turn_instruction_bits(0)
+    {
+        unsigned max_name_id = 0;
+        unsigned max_turn_instruction = 0;
+        for(uint64_t i = 0; i < records.size(); ++i) {
+            max_name_id = std::max(max_name_id, records[i].name_id);
+            max_turn_instruction = std::max(
+                max_turn_instruction,
+                unsigned(records[i].turn_instruction)
+            );
+        }
+        m_name_bits = GetBitWidth(max_name_id);
+        m_turn_instruction_bits = GetBitWidth(max_turn_instruction);
+
+        const uint64_t number_of_blocks =
+            (records.size() + COMPRESSED_EDGE_RECORD_BLOCK_SIZE - 1)/
+            COMPRESSED_EDGE_RECORD_BLOCK_SIZE;
+        m_blocks.resize(number_of_blocks);
+        for(uint64_t block_id = 0; block_id < number_of_blocks; ++block_id) {
+            const uint64_t begin = block_id*COMPRESSED_EDGE_RECORD_BLOCK_SIZE;
+            const uint64_t end = std::min(
+                begin + COMPRESSED_EDGE_RECORD_BLOCK_SIZE,
+                uint64_t(records.size())
+            );
+            BlockHeader & block = m_blocks[block_id];
+            block.min_lat = INT_MAX;
+            block.min_lon = INT_MAX;
+            int max_lat = INT_MIN;
+            int max_lon = INT_MIN;
+            for(uint64_t i = begin; i < end; ++i) {
+                const FixedPointCoordinate & coordinate = records[i].via_coordinate;
+                block.min_lat = std::min(block.min_lat, coordinate.lat);
+                block.min_lon = std::min(block.min_lon, coordinate.lon);
+                max_lat = std::max(max_lat, coordinate.lat);
+                max_lon = std::max(max_lon, coordinate.lon);
+            }
+            block.lat_bits = GetBitWidth(uint32_t(max_lat) - uint32_t(block.min_lat));
+            block.lon_bits = GetBitWidth(uint32_t(max_lon) - uint32_t(block.min_lon));
+            block.unused = 0;
+            if( UINT_MAX < m_words.size() ) {
+                throw OSRMException("too many edge records to compress");
+            }
+            block.first_word = m_words.size();
+
+            const uint64_t entry_bits = GetEntryBits(block);
+            m_words.resize(
+                m_words.size() + ((end - begin)*entry_bits + 63)/64,
+                0
+            );
+            for(uint64_t i = begin; i < end; ++i) {
+                const FixedPointCoordinate & coordinate = records[i].via_coordinate;
+                uint64_t bit_position =
+                    uint64_t(block.first_word)*64 + (i - begin)*entry_bits;
+                WriteBits(
+                    bit_position,
+                    uint32_t(coordinate.lat) - uint32_t(block.min_lat),
+                    block.lat_bits
+                );
+                bit_position += block.lat_bits;
+                WriteBits(
+                    bit_position,
+                    uint32_t(coordinate.lon) - uint32_t(block.min_lon),
+                    block.lon_bits
+                );
+                bit_position += block.lon_bits;
+                WriteBits(bit_position, records[i].name_id, m_name_bits);
+                bit_position += m_name_bits;
+                WriteBits(
+                    bit_position,
+                    records[i].turn_instruction,
+                    m_turn_instruction_bits
+                );
+            }
+        }
+        //reads may touch the word behind the last entry
+        m_words.push_back(0);
+
+        SimpleLogger().Write() <<
+            "compressed " << m_number_of_records << " edge records from " <<
+            (records.size()*sizeof(RecordT) >> 20) << " MB to " <<
+            (GetSizeInBytes() >> 20) << " MB";
+    }
+
+    inline FixedPointCoordinate GetCoordinate(const unsigned id) const {
+        const BlockHeader & block = GetBlock(id);
+        const uint64_t bit_position = GetEntryPosition(block, id);
+        return FixedPointCoordinate(
+            int(uint32_t(block.min_lat) + ReadBits(bit_position, block.lat_bits)),
+            int(uint32_t(block.min_lon) +
+                ReadBits(bit_position + block.lat_bits, block.lon_bits))
+        );
+    }
+
+    inline unsigned GetNameID(const unsigned id) const {
+        const BlockHeader & block = GetBlock(id);
+        return ReadBits(
+            GetEntryPosition(block, id) + block.lat_bits + block.lon_bits,
+            m_name_bits
+        );
+    }
+
+    inline TurnInstruction GetTurnInstruction(const unsigned id) const {
+        const BlockHeader & block = GetBlock(id);
+        return ReadBits(
+            GetEntryPosition(block, id) + block.lat_bits + block.lon_bits + m_name_bits,
+            m_turn_instruction_bits
+        );
+    }
+
+    inline uint64_t GetNumberOfRecords() const {
+        return m_number_of_records;
+    }
+
+    void AdviseHugePages() const {
+        if( m_blocks.empty() || m_words.empty() ) {
+            return;
+        }
+        ::AdviseHugePages(&m_blocks[0], m_blocks.size()*sizeof(BlockHeader));
+        ::AdviseHugePages(&m_words[0], m_words.size()*sizeof(uint64_t));
+    }
+
+    uint64_t GetSizeInBytes() const {
+        return m_blocks.size()*sizeof(BlockHeader) +
+            m_words.size()*sizeof(uint64_t);
+    }
+
+private:
+    struct BlockHeader {
+        int min_lat;
+        int min_lon;
+        uint32_t first_word;
+        uint8_t lat_bits;
+        uint8_t lon_bits;
+        uint16_t unused;
+    };
+
+    static inline unsigned GetBitWidth(uint32_t value) {
+        unsigned width = 0;
+        while( 0 != value ) {
+            ++width;
+            value >>= 1;
+        }
+        return width;
+    }
+
+    inline const BlockHeader & GetBlock(const unsigned id) const {
+        BOOST_ASSERT_MSG(id < m_number_of_records, "edge id out of range");
+        return m_blocks[id/COMPRESSED_EDGE_RECORD_BLOCK_SIZE];
+    }
+
+    inline unsigned GetEntryBits(const BlockHeader & block) const {
+        return block.lat_bits + block.lon_bits + m_name_bits + m_turn_instruction_bits;
+    }
+
+    inline uint64_t GetEntryPosition(const BlockHeader & block, const unsigned id) const {
+        return uint64_t(block.first_word)*64 +
+            (id%COMPRESSED_EDGE_RECORD_BLOCK_SIZE)*GetEntryBits(block);
+    }
+
+    inline void WriteBits(
+        const uint64_t bit_position,
+        const uint64_t value,
+        const unsigned width
+    ) {
+        if( 0 == width ) {
+            return;
+        }
+        const uint64_t word = bit_position >> 6;
+        const unsigned shift = bit_position & 63;
+        m_words[word] |= value << shift;
+        if( 64 < shift + width ) {
+            m_words[word+1] |= value >> (64 - shift);
+        }
+    }
+
+    //width is at most 32 bits
+    inline uint32_t ReadBits(const uint64_t bit_position, const unsigned width) const {
+        const uint64_t word = bit_position >> 6;
+        const unsigned shift = bit_position & 63;
+        uint64_t value = m_words[word] >> shift;
+        if( 64 < shift + width ) {
+            value |= m_words[word+1] << (64 - shift);
+        }
+        return value & ((uint64_t(1) << width) - 1);
+    }
+
+    uint64_t m_number_of_records;
+    unsigned m_name_bits;
+    unsigned m_turn_instruction_bits;
+    std::vector<BlockHeader> m_blocks;
+    std::vector<uint64_t> m_words;
+};
+
+#endif /* COMPRESSEDEDGERECORDS_H_ */
@@ -116,6 +116,22 @@ inline double ApproximateEuclideanDistance(const FixedPointCoordinate &c1, const
     return d;
 }
 
+//Initial bearing in degrees [0,360) when heading from A to B
+inline double ComputeBearing(const FixedPointCoordinate &A, const FixedPointCoordinate &B) {
+    const double RAD = 0.017453292519943295769236907684886;
+    const double delta_lon = (B.lon/COORDINATE_PRECISION - A.lon/COORDINATE_PRECISION)*RAD;
+    const double lat1 = (A.lat/COORDINATE_PRECISION)*RAD;
+    const double lat2 = (B.lat/COORDINATE_PRECISION)*RAD;
+
+    const double y = sin(delta_lon) * cos(lat2);
+    const double x = cos(lat1) * sin(lat2) - sin(lat1) * cos(lat2) * cos(delta_lon);
+    double result = atan2(y, x)/RAD;
+    if(result < 0.) {
+        result += 360.;
+    }
+    return result;
+}
+
 static inline void convertInternalLatLonToString(const int value, std::string & output) {
     char buffer[100];
     buffer[10] = 0; // Nullterminierung
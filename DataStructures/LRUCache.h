@@ -33,8 +33,9 @@ private:
         ValueT value;
     };
     unsigned capacity;
+    typedef boost::unordered_map<KeyT, typename std::list<CacheEntry>::iterator > PositionMap;
     std::list<CacheEntry> itemsInCache;
-    boost::unordered_map<KeyT, typename std::list<CacheEntry>::iterator > positionMap;
+    PositionMap positionMap;
 public:
     LRUCache(unsigned c) : capacity(c) {}
 
@@ -45,16 +46,14 @@ public:
         return false;
     }
 
-    void Insert(const KeyT key, ValueT &value) {
-        itemsInCache.push_front(CacheEntry(key, value));
-        positionMap.insert(std::make_pair(key, itemsInCache.begin()));
-        if(itemsInCache.size() > capacity) {
-            positionMap.erase(itemsInCache.back().key);
-            itemsInCache.pop_back();
+    void Insert(const KeyT key, const ValueT & value) {
+        typename PositionMap::iterator position = positionMap.find(key);
+        if(position != positionMap.end()) {
+            //update existing entry and move it to front
+            position->second->value = value;
+            itemsInCache.splice(itemsInCache.begin(), itemsInCache, position->second);
+            return;
         }
-    }
-
-    void Insert(const KeyT key, ValueT value) {
         itemsInCache.push_front(CacheEntry(key, value));
         positionMap.insert(std::make_pair(key, itemsInCache.begin()));
         if(itemsInCache.size() > capacity) {
@@ -64,17 +63,22 @@ public:
     }
 
     bool Fetch(const KeyT key, ValueT& result) {
-        if(Holds(key)) {
-            CacheEntry e = *(positionMap.find(key)->second);
-            result = e.value;
-
-            //move to front
-            itemsInCache.splice(positionMap.find(key)->second, itemsInCache, itemsInCache.begin());
-            positionMap.find(key)->second = itemsInCache.begin();
-            return true;
+        typename PositionMap::iterator position = positionMap.find(key);
+        if(position == positionMap.end()) {
+            return false;
         }
-        return false;
+        result = position->second->value;
+
+        //move to front, list iterators stay valid
+        itemsInCache.splice(itemsInCache.begin(), itemsInCache, position->second);
+        return true;
     }
+
+    void Clear() {
+        itemsInCache.clear();
+        positionMap.clear();
+    }
+
     unsigned Size() const {
         return itemsInCache.size();
     }
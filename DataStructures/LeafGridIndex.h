@@ -0,0 +1,282 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef LEAFGRIDINDEX_H_
+#define LEAFGRIDINDEX_H_
+
+#include "Coordinate.h"
+#include "../Util/OSRMException.h"
+#include "../Util/SimpleLogger.h"
+
+#include <boost/assert.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/integer.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+//tuning parameters, a cell spans 2^13 fixed point units, i.e. ~900m
+const static uint32_t GRID_CELL_SHIFT = 13;
+const static uint32_t GRID_MAX_CELLS_PER_LEAF = 256;
+const static uint32_t GRID_MAX_LEAFS_PER_CELL = 4;
+const static uint32_t GRID_MAGIC_NUMBER = 0x4c475244;
+
+// Sparse uniform grid in front of the r-tree. Each stored cell lists every
+// leaf whose MBR intersects the cell. Cells that would be covered by too many
+// leafs, or by a leaf that is too large to be registered, are not stored and
+// queries falling into them have to use the tree.
+
+class LeafGridIndex : boost::noncopyable {
+public:
+    struct GridCell {
+        uint64_t key;
+        uint32_t first_leaf;
+        uint32_t leaf_count;
+
+        inline bool operator<(const GridCell & other) const {
+            return key < other.key;
+        }
+    };
+
+    struct CellBounds {
+        int32_t min_lat, max_lat;
+        int32_t min_lon, max_lon;
+    };
+
+    //Generates the grid file at preprocessing time from the leafs' MBRs
+    template<class RectangleT>
+    static void Build(
+        const std::vector<RectangleT> & leaf_rectangles,
+        const std::string & grid_filename
+    ) {
+        std::vector<std::pair<uint64_t, uint32_t> > cell_leaf_pairs;
+        std::vector<uint32_t> large_leafs;
+        for(uint32_t i = 0; i < leaf_rectangles.size(); ++i) {
+            const RectangleT & rectangle = leaf_rectangles[i];
+            const uint32_t min_row = GetRow(rectangle.min_lat);
+            const uint32_t max_row = GetRow(rectangle.max_lat);
+            const uint32_t min_col = GetColumn(rectangle.min_lon);
+            const uint32_t max_col = GetColumn(rectangle.max_lon);
+            const uint64_t covered_cells =
+                uint64_t(max_row - min_row + 1) * (max_col - min_col + 1);
+            if(GRID_MAX_CELLS_PER_LEAF < covered_cells) {
+                large_leafs.push_back(i);
+                continue;
+            }
+            for(uint32_t row = min_row; row <= max_row; ++row) {
+                for(uint32_t col = min_col; col <= max_col; ++col) {
+                    cell_leaf_pairs.push_back(std::make_pair(GetKey(row, col), i));
+                }
+            }
+        }
+        std::sort(cell_leaf_pairs.begin(), cell_leaf_pairs.end());
+
+        std::vector<GridCell> cells;
+        for(uint32_t i = 0; i < cell_leaf_pairs.size(); ++i) {
+            if(cells.empty() || cells.back().key != cell_leaf_pairs[i].first) {
+                GridCell cell;
+                cell.key = cell_leaf_pairs[i].first;
+                cell.first_leaf = i;
+                cell.leaf_count = 0;
+                cells.push_back(cell);
+            }
+            ++cells.back().leaf_count;
+        }
+
+        //a cell is only sound if all leafs intersecting it are listed
+        std::vector<bool> is_cell_usable(cells.size(), true);
+        for(uint32_t i = 0; i < cells.size(); ++i) {
+            if(GRID_MAX_LEAFS_PER_CELL < cells[i].leaf_count) {
+                is_cell_usable[i] = false;
+            }
+        }
+        for(uint32_t i = 0; i < large_leafs.size(); ++i) {
+            const RectangleT & rectangle = leaf_rectangles[large_leafs[i]];
+            const uint32_t min_col = GetColumn(rectangle.min_lon);
+            const uint32_t max_col = GetColumn(rectangle.max_lon);
+            for(
+                uint32_t row = GetRow(rectangle.min_lat);
+                row <= GetRow(rectangle.max_lat);
+                ++row
+            ) {
+                GridCell first_cell;
+                first_cell.key = GetKey(row, min_col);
+                const uint64_t last_key = GetKey(row, max_col);
+                for(
+                    std::vector<GridCell>::iterator it = std::lower_bound(
+                        cells.begin(), cells.end(), first_cell
+                    );
+                    it != cells.end() && it->key <= last_key;
+                    ++it
+                ) {
+                    is_cell_usable[it - cells.begin()] = false;
+                }
+            }
+        }
+
+        std::vector<GridCell> usable_cells;
+        std::vector<uint32_t> leaf_ids;
+        for(uint32_t i = 0; i < cells.size(); ++i) {
+            if(!is_cell_usable[i]) {
+                continue;
+            }
+            GridCell cell = cells[i];
+            cell.first_leaf = leaf_ids.size();
+            for(uint32_t j = 0; j < cells[i].leaf_count; ++j) {
+                leaf_ids.push_back(cell_leaf_pairs[cells[i].first_leaf + j].second);
+            }
+            usable_cells.push_back(cell);
+        }
+
+        GridHeader header;
+        header.magic_number = GRID_MAGIC_NUMBER;
+        header.cell_shift = GRID_CELL_SHIFT;
+        header.number_of_cells = usable_cells.size();
+        header.number_of_leaf_ids = leaf_ids.size();
+
+        boost::filesystem::ofstream grid_file(grid_filename, std::ios::binary);
+        grid_file.write((char*)&header, sizeof(GridHeader));
+        if(!usable_cells.empty()) {
+            grid_file.write((char*)&usable_cells[0], sizeof(GridCell)*usable_cells.size());
+            grid_file.write((char*)&leaf_ids[0], sizeof(uint32_t)*leaf_ids.size());
+        }
+        grid_file.close();
+
+        SimpleLogger().Write() <<
+            "grid index has " << usable_cells.size() << " of " <<
+            cells.size() << " occupied cells, " << large_leafs.size() <<
+            " leafs too large to be gridded";
+    }
+
+    //Maps an existing grid file read-only into memory
+    explicit LeafGridIndex(const std::string & grid_filename) {
+        boost::filesystem::path grid_file(grid_filename);
+        if ( !boost::filesystem::exists( grid_file ) ) {
+            throw OSRMException("grid index file does not exist");
+        }
+        if ( boost::filesystem::file_size( grid_file ) < sizeof(GridHeader) ) {
+            throw OSRMException("grid index file is truncated");
+        }
+
+        boost::interprocess::file_mapping file_mapping(
+            grid_filename.c_str(),
+            boost::interprocess::read_only
+        );
+        boost::interprocess::mapped_region mapped_region(
+            file_mapping,
+            boost::interprocess::read_only
+        );
+        m_file_mapping.swap(file_mapping);
+        m_mapped_region.swap(mapped_region);
+        SetArrays(
+            static_cast<const char *>(m_mapped_region.get_address()),
+            m_mapped_region.get_size()
+        );
+    }
+
+    //Views the bytes of a grid file that are already in memory
+    LeafGridIndex(const char * grid_data, const uint64_t grid_size) {
+        SetArrays(grid_data, grid_size);
+    }
+
+    //Returns false if the coordinate falls into a cell that is not gridded
+    inline bool FindLeafsForCoordinate(
+        const FixedPointCoordinate & coordinate,
+        const uint32_t * & leaf_ids,
+        uint32_t & leaf_count,
+        CellBounds & bounds
+    ) const {
+        if(!coordinate.isValid() || GRID_CELL_SHIFT != m_cell_shift) {
+            return false;
+        }
+        const uint32_t row = GetRow(coordinate.lat);
+        const uint32_t col = GetColumn(coordinate.lon);
+        GridCell query_cell;
+        query_cell.key = GetKey(row, col);
+        const GridCell * cell = std::lower_bound(m_cells_begin, m_cells_end, query_cell);
+        if( cell == m_cells_end || cell->key != query_cell.key ) {
+            return false;
+        }
+        leaf_ids = m_leaf_ids + cell->first_leaf;
+        leaf_count = cell->leaf_count;
+        bounds.min_lat = (int64_t(row) << GRID_CELL_SHIFT) - 90*COORDINATE_PRECISION;
+        bounds.max_lat = bounds.min_lat + (1 << GRID_CELL_SHIFT);
+        bounds.min_lon = (int64_t(col) << GRID_CELL_SHIFT) - 180*COORDINATE_PRECISION;
+        bounds.max_lon = bounds.min_lon + (1 << GRID_CELL_SHIFT);
+        return true;
+    }
+
+private:
+    struct GridHeader {
+        uint32_t magic_number;
+        uint32_t cell_shift;
+        uint32_t number_of_cells;
+        uint32_t number_of_leaf_ids;
+    };
+
+    void SetArrays(const char * base, const uint64_t size) {
+        if( size < sizeof(GridHeader) ) {
+            throw OSRMException("grid index file is truncated");
+        }
+        const GridHeader * header = reinterpret_cast<const GridHeader *>(base);
+        if( GRID_MAGIC_NUMBER != header->magic_number ) {
+            throw OSRMException("grid index file misses magic number");
+        }
+        const uint64_t expected_size = sizeof(GridHeader) +
+            uint64_t(header->number_of_cells)*sizeof(GridCell) +
+            uint64_t(header->number_of_leaf_ids)*sizeof(uint32_t);
+        if( size < expected_size ) {
+            throw OSRMException("grid index file is truncated");
+        }
+        m_cell_shift = header->cell_shift;
+        m_cells_begin = reinterpret_cast<const GridCell *>(base + sizeof(GridHeader));
+        m_cells_end = m_cells_begin + header->number_of_cells;
+        m_leaf_ids = reinterpret_cast<const uint32_t *>(m_cells_end);
+        SimpleLogger().Write() <<
+            "mapped grid index with " << header->number_of_cells << " cells";
+    }
+
+    static inline uint32_t GetRow(const int32_t lat) {
+        return (int64_t(lat) + int64_t(90*COORDINATE_PRECISION)) >> GRID_CELL_SHIFT;
+    }
+
+    static inline uint32_t GetColumn(const int32_t lon) {
+        return (int64_t(lon) + int64_t(180*COORDINATE_PRECISION)) >> GRID_CELL_SHIFT;
+    }
+
+    static inline uint64_t GetKey(const uint32_t row, const uint32_t col) {
+        return (uint64_t(row) << 32) | col;
+    }
+
+    boost::interprocess::file_mapping m_file_mapping;
+    boost::interprocess::mapped_region m_mapped_region;
+    uint32_t m_cell_shift;
+    const GridCell * m_cells_begin;
+    const GridCell * m_cells_end;
+    const uint32_t * m_leaf_ids;
+};
+
+#endif /* LEAFGRIDINDEX_H_ */
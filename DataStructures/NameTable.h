@@ -0,0 +1,247 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef NAMETABLE_H_
+#define NAMETABLE_H_
+
+#include "../Util/FileLoader.h"
+#include "../Util/OSRMException.h"
+#include "../Util/StringUtil.h"
+
+#include <boost/assert.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/integer.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+const static uint32_t NAME_TABLE_MAGIC_NUMBER = 0x454d414e;
+const static uint32_t NAME_TABLE_VERSION = 2;
+
+// Street names as one block of characters with an offset array. Names are
+// stored escaped for JSON output, so they are appended to replies as they
+// are. Name id 0 and unknown ids stand for unnamed streets.
+//
+// File layout: NameTableHeader, number_of_names+1 offsets, characters.
+// Files of the previous format, a count followed by length prefixed raw
+// names, are escaped while they are loaded.
+
+class NameTable : boost::noncopyable {
+public:
+    struct NameTableHeader {
+        uint32_t magic_number;
+        uint32_t version;
+        uint32_t number_of_names;
+        uint32_t number_of_characters;
+    };
+
+    NameTable() :
+        m_offset_array(NULL),
+        m_character_array(NULL),
+        m_number_of_names(0)
+    { }
+
+    //Escapes raw names and writes them as a name table
+    template<class IteratorT>
+    static void Write(
+        IteratorT raw_name,
+        const IteratorT end,
+        const std::string & filename
+    ) {
+        std::vector<uint32_t> offsets(1, 0);
+        std::string characters;
+        for( ; raw_name != end; ++raw_name ) {
+            characters += EscapeName(*raw_name);
+            if( std::numeric_limits<uint32_t>::max() < characters.size() ) {
+                throw OSRMException("names exceed the capacity of the name table");
+            }
+            offsets.push_back(characters.size());
+        }
+        NameTableHeader header;
+        header.magic_number = NAME_TABLE_MAGIC_NUMBER;
+        header.version = NAME_TABLE_VERSION;
+        header.number_of_names = offsets.size() - 1;
+        header.number_of_characters = characters.size();
+
+        boost::filesystem::ofstream name_stream(filename, std::ios::binary);
+        name_stream.write((char *)&header, sizeof(NameTableHeader));
+        name_stream.write((char *)&offsets[0], offsets.size()*sizeof(uint32_t));
+        name_stream.write(characters.data(), characters.size());
+        name_stream.close();
+    }
+
+    //Escapes like the responses always did, plus control characters
+    static std::string EscapeName(const std::string & raw_name) {
+        const std::string entitized_name = HTMLEntitize(raw_name);
+        std::string escaped_name;
+        escaped_name.reserve(entitized_name.size());
+        for( unsigned i = 0; i < entitized_name.size(); ++i ) {
+            const unsigned char c = entitized_name[i];
+            if( 0x20 > c ) {
+                char escape_sequence[8];
+                std::sprintf(escape_sequence, "\\u%04x", unsigned(c));
+                escaped_name += escape_sequence;
+            } else {
+                escaped_name += c;
+            }
+        }
+        return escaped_name;
+    }
+
+    void Load(const std::string & filename) {
+        boost::filesystem::path names_file(filename);
+        if ( !boost::filesystem::exists( names_file ) ) {
+            throw OSRMException("names file does not exist");
+        }
+        if ( 0 == boost::filesystem::file_size( names_file ) ) {
+            throw OSRMException("names file is empty");
+        }
+        m_file_data.resize(boost::filesystem::file_size(names_file));
+        ReadFileRange(filename, 0, &m_file_data[0], m_file_data.size());
+        Parse(&m_file_data[0], &m_file_data[0] + m_file_data.size());
+    }
+
+    //Views the contents of a names file in memory that outlives the table,
+    //only names in the previous format are copied
+    void Parse(const char * begin, const char * end) {
+        if( end - begin < std::ptrdiff_t(sizeof(uint32_t)) ) {
+            throw OSRMException("names file is truncated");
+        }
+        uint32_t first_word = 0;
+        std::memcpy(&first_word, begin, sizeof(uint32_t));
+        if( NAME_TABLE_MAGIC_NUMBER != first_word ) {
+            ConvertPreviousFormat(begin, end);
+            return;
+        }
+        if( end - begin < std::ptrdiff_t(sizeof(NameTableHeader)) ) {
+            throw OSRMException("names file is truncated");
+        }
+        const NameTableHeader * header = reinterpret_cast<const NameTableHeader *>(begin);
+        if( NAME_TABLE_VERSION != header->version ) {
+            throw OSRMException("names file has an unknown version");
+        }
+        const uint64_t expected_size = sizeof(NameTableHeader) +
+            (uint64_t(header->number_of_names) + 1)*sizeof(uint32_t) +
+            header->number_of_characters;
+        if( uint64_t(end - begin) < expected_size ) {
+            throw OSRMException("names file is truncated");
+        }
+        const uint32_t * offsets =
+            reinterpret_cast<const uint32_t *>(begin + sizeof(NameTableHeader));
+        View(
+            offsets,
+            reinterpret_cast<const char *>(offsets + header->number_of_names + 1),
+            header->number_of_names
+        );
+    }
+
+    //Views names stored elsewhere, e.g. in shared memory
+    void View(
+        const uint32_t * offsets,
+        const char * characters,
+        const uint32_t number_of_names
+    ) {
+        m_offset_array = offsets;
+        m_character_array = characters;
+        m_number_of_names = number_of_names;
+    }
+
+    inline void AppendEscapedName(const unsigned name_id, std::string & output) const {
+        if( 0 == name_id || m_number_of_names <= name_id ) {
+            return;
+        }
+        output.append(
+            m_character_array + m_offset_array[name_id],
+            m_character_array + m_offset_array[name_id+1]
+        );
+    }
+
+    inline std::string GetEscapedName(const unsigned name_id) const {
+        std::string name;
+        AppendEscapedName(name_id, name);
+        return name;
+    }
+
+    uint32_t GetNumberOfNames() const {
+        return m_number_of_names;
+    }
+
+    const uint32_t * GetOffsets() const {
+        return m_offset_array;
+    }
+
+    uint32_t GetNumberOfCharacters() const {
+        return NULL == m_offset_array ? 0 : m_offset_array[m_number_of_names];
+    }
+
+    const char * GetCharacters() const {
+        return m_character_array;
+    }
+
+private:
+    void ConvertPreviousFormat(const char * begin, const char * end) {
+        uint32_t number_of_names = 0;
+        std::memcpy(&number_of_names, begin, sizeof(uint32_t));
+        begin += sizeof(uint32_t);
+        BOOST_ASSERT_MSG(0 != number_of_names, "name file empty");
+
+        std::string characters;
+        m_offsets.assign(1, 0);
+        m_offsets.reserve(number_of_names + 1);
+        for( uint32_t i = 0; i < number_of_names; ++i ) {
+            uint32_t length_of_name = 0;
+            if( end - begin < std::ptrdiff_t(sizeof(uint32_t)) ) {
+                throw OSRMException("names file is truncated");
+            }
+            std::memcpy(&length_of_name, begin, sizeof(uint32_t));
+            begin += sizeof(uint32_t);
+            if( end - begin < std::ptrdiff_t(length_of_name) ) {
+                throw OSRMException("names file is truncated");
+            }
+            characters += EscapeName(std::string(begin, begin + length_of_name));
+            begin += length_of_name;
+            m_offsets.push_back(characters.size());
+        }
+        m_characters.assign(characters.begin(), characters.end());
+        std::vector<char>().swap(m_file_data);
+        View(
+            &m_offsets[0],
+            m_characters.empty() ? NULL : &m_characters[0],
+            number_of_names
+        );
+    }
+
+    //owned storage, unused if the names are only viewed
+    std::vector<char> m_file_data;
+    std::vector<uint32_t> m_offsets;
+    std::vector<char> m_characters;
+
+    const uint32_t * m_offset_array;
+    const char * m_character_array;
+    uint32_t m_number_of_names;
+};
+
+#endif /* NAMETABLE_H_ */
@@ -21,11 +21,16 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #ifndef NODEINFORMATIONHELPDESK_H_
 #define NODEINFORMATIONHELPDESK_H_
 
+#include "CompressedEdgeRecords.h"
 #include "QueryNode.h"
 #include "PhantomNodes.h"
+#include "PhantomNodeCache.h"
 #include "StaticRTree.h"
 #include "../Contractor/EdgeBasedGraphFactory.h"
+#include "../Util/FileLoader.h"
+#include "../Util/OpenMPWrapper.h"
 #include "../Util/OSRMException.h"
+#include "../Util/QueryMetrics.h"
 #include "../typedefs.h"
 
 #include <boost/assert.hpp>
@@ -41,71 +46,114 @@ typedef EdgeBasedGraphFactory::EdgeBasedNode RTreeLeaf;
 
 class NodeInformationHelpDesk : boost::noncopyable {
 public:
+    //everything that is looked up for an unpacked edge, packed into 16 bytes
+    struct OriginalEdgeRecord {
+        FixedPointCoordinate via_coordinate;
+        unsigned name_id;
+        TurnInstruction turn_instruction;
+    };
+
+    //Takes over edge records and an r-tree that were loaded beforehand, the
+    //records are swapped out of the vector
     NodeInformationHelpDesk(
-        const std::string & ramIndexInput,
-        const std::string & fileIndexInput,
-        const std::string & nodes_filename,
-        const std::string & edges_filename,
+        StaticRTree<RTreeLeaf> * rtree,
+        std::vector<OriginalEdgeRecord> & records,
         const unsigned number_of_nodes,
-        const unsigned check_sum
-    ) : number_of_nodes(number_of_nodes), check_sum(check_sum)
+        const unsigned check_sum,
+        const unsigned phantom_node_cache_size = 0,
+        const unsigned phantom_node_cache_resolution = 1,
+        const bool compress_edge_records = false
+    ) :
+        edge_record_array(NULL),
+        number_of_edge_records(records.size()),
+        compressed_edge_records(NULL),
+        read_only_rtree(rtree),
+        phantom_node_cache(NULL),
+        number_of_nodes(number_of_nodes),
+        check_sum(check_sum)
     {
-        if ( ramIndexInput.empty() ) {
-            throw OSRMException("no ram index file name in server ini");
-        }
-        if ( fileIndexInput.empty() ) {
-            throw OSRMException("no mem index file name in server ini");
-        }
-        if ( nodes_filename.empty() ) {
-            throw OSRMException("no nodes file name in server ini");
+        if( 0 < phantom_node_cache_size ) {
+            phantom_node_cache = new PhantomNodeCache(
+                phantom_node_cache_size,
+                phantom_node_cache_resolution
+            );
         }
-        if ( edges_filename.empty() ) {
-            throw OSRMException("no edges file name in server ini");
+        if( compress_edge_records ) {
+            compressed_edge_records = new CompressedEdgeRecords(records);
+            std::vector<OriginalEdgeRecord>().swap(records);
+        } else {
+            edge_records.swap(records);
+            edge_record_array = edge_records.empty() ? NULL : &edge_records[0];
         }
+    }
 
-        read_only_rtree = new StaticRTree<RTreeLeaf>(
-            ramIndexInput,
-            fileIndexInput
-        );
-        BOOST_ASSERT_MSG(
-            0 == coordinateVector.size(),
-            "Coordinate vector not empty"
-        );
-
-        LoadNodesAndEdges(nodes_filename, edges_filename);
+    //Views edge records that were loaded elsewhere, e.g. into shared memory,
+    //and takes ownership of the r-tree
+    NodeInformationHelpDesk(
+        StaticRTree<RTreeLeaf> * rtree,
+        const OriginalEdgeRecord * records,
+        const unsigned number_of_records,
+        const unsigned number_of_nodes,
+        const unsigned check_sum,
+        const unsigned phantom_node_cache_size = 0,
+        const unsigned phantom_node_cache_resolution = 1
+    ) :
+        edge_record_array(records),
+        number_of_edge_records(number_of_records),
+        compressed_edge_records(NULL),
+        read_only_rtree(rtree),
+        phantom_node_cache(NULL),
+        number_of_nodes(number_of_nodes),
+        check_sum(check_sum)
+    {
+        if( 0 < phantom_node_cache_size ) {
+            phantom_node_cache = new PhantomNodeCache(
+                phantom_node_cache_size,
+                phantom_node_cache_resolution
+            );
+        }
     }
 
-    //Todo: Shared memory mechanism
 	~NodeInformationHelpDesk() {
 		delete read_only_rtree;
+		delete phantom_node_cache;
+		delete compressed_edge_records;
 	}
 
+    //called for every unpacked edge, range checks only in debug builds
+    inline FixedPointCoordinate getCoordinateOfNode(const unsigned id) const {
+        if( NULL != compressed_edge_records ) {
+            return compressed_edge_records->GetCoordinate(id);
+        }
+        return getEdgeRecord(id).via_coordinate;
+    }
+
 	inline int getLatitudeOfNode(const unsigned id) const {
-	    const NodeID node = origEdgeData_viaNode.at(id);
-	    return coordinateVector.at(node).lat;
+	    return getCoordinateOfNode(id).lat;
 	}
 
 	inline int getLongitudeOfNode(const unsigned id) const {
-        const NodeID node = origEdgeData_viaNode.at(id);
-	    return coordinateVector.at(node).lon;
+	    return getCoordinateOfNode(id).lon;
 	}
 
 	inline unsigned getNameIndexFromEdgeID(const unsigned id) const {
-	    return origEdgeData_nameID.at(id);
+	    if( NULL != compressed_edge_records ) {
+	        return compressed_edge_records->GetNameID(id);
+	    }
+	    return getEdgeRecord(id).name_id;
 	}
 
     inline TurnInstruction getTurnInstructionFromEdgeID(const unsigned id) const {
-        return origEdgeData_turnInstruction.at(id);
+        if( NULL != compressed_edge_records ) {
+            return compressed_edge_records->GetTurnInstruction(id);
+        }
+        return getEdgeRecord(id).turn_instruction;
     }
 
     inline NodeID getNumberOfNodes() const {
         return number_of_nodes;
     }
 
-	inline NodeID getNumberOfNodes2() const {
-        return coordinateVector.size();
-    }
-
     inline bool FindNearestNodeCoordForLatLon(
             const FixedPointCoordinate& input_coordinate,
             FixedPointCoordinate& result,
@@ -123,29 +171,74 @@ public:
     inline bool FindPhantomNodeForCoordinate(
             const FixedPointCoordinate & input_coordinate,
             PhantomNode & resulting_phantom_node,
-            const unsigned zoom_level
+            const unsigned zoom_level,
+            const BearingFilter & bearing_filter = BearingFilter()
     ) const {
-        return read_only_rtree->FindPhantomNodeForCoordinate(
+        ScopedPhaseTimer snapping_timer(phaseSnapping);
+        //filtered lookups are not cached
+        const bool use_cache =
+            NULL != phantom_node_cache && !bearing_filter.IsActive();
+        if(
+            use_cache &&
+            phantom_node_cache->Fetch(
+                input_coordinate,
+                zoom_level,
+                check_sum,
+                resulting_phantom_node
+            )
+        ) {
+            return true;
+        }
+        const bool found_node = read_only_rtree->FindPhantomNodeForCoordinate(
                 input_coordinate,
                 resulting_phantom_node,
-                zoom_level
+                zoom_level,
+                bearing_filter
         );
+        if( found_node && use_cache ) {
+            phantom_node_cache->Insert(
+                input_coordinate,
+                zoom_level,
+                check_sum,
+                resulting_phantom_node
+            );
+        }
+        return found_node;
+    }
+
+    //NULL if the cache is disabled
+    inline const PhantomNodeCache * GetPhantomNodeCache() const {
+        return phantom_node_cache;
     }
 
 	inline unsigned GetCheckSum() const {
 	    return check_sum;
 	}
 
-private:
-    void LoadNodesAndEdges(
+    void AdviseHugePages() const {
+        if( NULL != edge_record_array ) {
+            ::AdviseHugePages(
+                edge_record_array,
+                uint64_t(number_of_edge_records)*sizeof(OriginalEdgeRecord)
+            );
+        }
+        if( NULL != compressed_edge_records ) {
+            compressed_edge_records->AdviseHugePages();
+        }
+        read_only_rtree->AdviseHugePages();
+    }
+
+    //Joins the original edges with the coordinates of their via nodes
+    static void LoadEdgeRecords(
         const std::string & nodes_filename,
-        const std::string & edges_filename
+        const std::string & edges_filename,
+        std::vector<OriginalEdgeRecord> & edge_records
     ) {
         boost::filesystem::path nodes_file(nodes_filename);
         if ( !boost::filesystem::exists( nodes_file ) ) {
             throw OSRMException("nodes file does not exist");
         }
-        if ( 0 == boost::filesystem::file_size( nodes_file ) ) {
+        if ( boost::filesystem::file_size( nodes_file ) < sizeof(NodeInfo) ) {
             throw OSRMException("nodes file is empty");
         }
 
@@ -157,46 +250,81 @@ private:
             throw OSRMException("edges file is empty");
         }
 
-        boost::filesystem::ifstream nodes_input_stream(nodes_file, std::ios::binary);
+        unsigned numberOfOrigEdges(0);
         boost::filesystem::ifstream edges_input_stream(edges_file, std::ios::binary);
-
-        SimpleLogger().Write(logDEBUG) << "Loading node data";
-        NodeInfo b;
-        while(!nodes_input_stream.eof()) {
-            nodes_input_stream.read((char *)&b, sizeof(NodeInfo));
-            coordinateVector.push_back(FixedPointCoordinate(b.lat, b.lon));
+        edges_input_stream.read((char*)&numberOfOrigEdges, sizeof(unsigned));
+        edges_input_stream.close();
+        if( boost::filesystem::file_size( edges_file ) <
+            sizeof(unsigned) + uint64_t(numberOfOrigEdges)*sizeof(OriginalEdgeData)
+        ) {
+            throw OSRMException("edges file is truncated");
         }
-        std::vector<FixedPointCoordinate>(coordinateVector).swap(coordinateVector);
-        nodes_input_stream.close();
 
-        SimpleLogger().Write(logDEBUG) << "Loading edge data";
-        unsigned numberOfOrigEdges(0);
-        edges_input_stream.read((char*)&numberOfOrigEdges, sizeof(unsigned));
-        origEdgeData_viaNode.resize(numberOfOrigEdges);
-        origEdgeData_nameID.resize(numberOfOrigEdges);
-        origEdgeData_turnInstruction.resize(numberOfOrigEdges);
-
-        OriginalEdgeData deserialized_originalEdgeData;
-        for(unsigned i = 0; i < numberOfOrigEdges; ++i) {
-            edges_input_stream.read(
-                (char*)&(deserialized_originalEdgeData),
-                sizeof(OriginalEdgeData)
+        //both files are read at the same time
+        const uint64_t number_of_node_infos =
+            boost::filesystem::file_size( nodes_file )/sizeof(NodeInfo);
+        std::vector<NodeInfo> node_infos(number_of_node_infos);
+        std::vector<OriginalEdgeData> original_edge_data(numberOfOrigEdges);
+        ConcurrentLoader loader;
+        loader.Add(
+            "node data",
+            boost::bind(
+                &ReadFileRange,
+                nodes_filename,
+                0,
+                (char *)&node_infos[0],
+                number_of_node_infos*sizeof(NodeInfo)
+            )
+        );
+        if( 0 < numberOfOrigEdges ) {
+            loader.Add(
+                "edge data",
+                boost::bind(
+                    &ReadFileRange,
+                    edges_filename,
+                    sizeof(unsigned),
+                    (char *)&original_edge_data[0],
+                    uint64_t(numberOfOrigEdges)*sizeof(OriginalEdgeData)
+                )
             );
-            origEdgeData_viaNode[i] = deserialized_originalEdgeData.viaNode;
-            origEdgeData_nameID[i]  = deserialized_originalEdgeData.nameID;
-            origEdgeData_turnInstruction[i] = deserialized_originalEdgeData.turnInstruction;
         }
-        edges_input_stream.close();
+        loader.Run();
+
+        edge_records.resize(numberOfOrigEdges);
+        int number_of_unknown_nodes = 0;
+        #pragma omp parallel for reduction(+:number_of_unknown_nodes)
+        for(int i = 0; i < int(numberOfOrigEdges); ++i) {
+            const OriginalEdgeData & edge_data = original_edge_data[i];
+            if( node_infos.size() <= edge_data.viaNode ) {
+                ++number_of_unknown_nodes;
+                continue;
+            }
+            const NodeInfo & via_node = node_infos[edge_data.viaNode];
+            edge_records[i].via_coordinate = FixedPointCoordinate(via_node.lat, via_node.lon);
+            edge_records[i].name_id = edge_data.nameID;
+            edge_records[i].turn_instruction = edge_data.turnInstruction;
+        }
+        if( 0 != number_of_unknown_nodes ) {
+            throw OSRMException("edges file references unknown node");
+        }
         SimpleLogger().Write(logDEBUG) << "Loaded " << numberOfOrigEdges << " orig edges";
-        SimpleLogger().Write(logDEBUG) << "Opening NN indices";
     }
 
-	std::vector<FixedPointCoordinate> coordinateVector;
-	std::vector<NodeID> origEdgeData_viaNode;
-	std::vector<unsigned> origEdgeData_nameID;
-	std::vector<TurnInstruction> origEdgeData_turnInstruction;
+private:
+    inline const OriginalEdgeRecord & getEdgeRecord(const unsigned id) const {
+        BOOST_ASSERT_MSG(id < number_of_edge_records, "edge id out of range");
+        return edge_record_array[id];
+    }
+
+	std::vector<OriginalEdgeRecord> edge_records;
+	//points into edge_records or into memory that is only viewed
+	const OriginalEdgeRecord * edge_record_array;
+	unsigned number_of_edge_records;
+	//replaces edge_records if they are kept compressed
+	CompressedEdgeRecords * compressed_edge_records;
 
 	StaticRTree<EdgeBasedGraphFactory::EdgeBasedNode> * read_only_rtree;
+	PhantomNodeCache * phantom_node_cache;
 	const unsigned number_of_nodes;
 	const unsigned check_sum;
 };
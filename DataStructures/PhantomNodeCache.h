@@ -0,0 +1,167 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef PHANTOMNODECACHE_H_
+#define PHANTOMNODECACHE_H_
+
+#include "Coordinate.h"
+#include "LRUCache.h"
+#include "PhantomNodes.h"
+
+#include <boost/assert.hpp>
+#include <boost/integer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <vector>
+
+const static uint32_t PHANTOM_NODE_CACHE_SHARDS = 16;
+
+// Bounded cache of snapped coordinates shared by all request threads. It is
+// split into shards with a lock each, so that concurrent lookups seldomly
+// contend. Coordinates are quantized to 'resolution' fixed point units; with a
+// resolution of 1 only identical coordinates share an entry.
+
+class PhantomNodeCache : boost::noncopyable {
+public:
+    PhantomNodeCache(
+        const unsigned capacity,
+        const unsigned resolution
+    ) : m_resolution(std::max(1u, resolution)) {
+        const unsigned shard_capacity = std::max(
+            1u,
+            capacity/PHANTOM_NODE_CACHE_SHARDS
+        );
+        for(uint32_t i = 0; i < PHANTOM_NODE_CACHE_SHARDS; ++i) {
+            m_shards.push_back(new CacheShard(shard_capacity));
+        }
+    }
+
+    ~PhantomNodeCache() {
+        for(uint32_t i = 0; i < m_shards.size(); ++i) {
+            delete m_shards[i];
+        }
+    }
+
+    inline bool Fetch(
+        const FixedPointCoordinate & coordinate,
+        const unsigned zoom_level,
+        const unsigned check_sum,
+        PhantomNode & result
+    ) {
+        const uint64_t key = GetKey(coordinate, zoom_level);
+        CacheShard & shard = GetShard(key);
+        boost::mutex::scoped_lock lock(shard.mutex);
+        InvalidateOnNewData(shard, check_sum);
+        if(shard.cache.Fetch(key, result)) {
+            ++shard.hits;
+            return true;
+        }
+        ++shard.misses;
+        return false;
+    }
+
+    inline void Insert(
+        const FixedPointCoordinate & coordinate,
+        const unsigned zoom_level,
+        const unsigned check_sum,
+        const PhantomNode & phantom_node
+    ) {
+        const uint64_t key = GetKey(coordinate, zoom_level);
+        CacheShard & shard = GetShard(key);
+        boost::mutex::scoped_lock lock(shard.mutex);
+        InvalidateOnNewData(shard, check_sum);
+        shard.cache.Insert(key, phantom_node);
+    }
+
+    uint64_t GetNumberOfHits() const {
+        uint64_t hits = 0;
+        for(uint32_t i = 0; i < m_shards.size(); ++i) {
+            boost::mutex::scoped_lock lock(m_shards[i]->mutex);
+            hits += m_shards[i]->hits;
+        }
+        return hits;
+    }
+
+    uint64_t GetNumberOfMisses() const {
+        uint64_t misses = 0;
+        for(uint32_t i = 0; i < m_shards.size(); ++i) {
+            boost::mutex::scoped_lock lock(m_shards[i]->mutex);
+            misses += m_shards[i]->misses;
+        }
+        return misses;
+    }
+
+    uint64_t GetNumberOfEntries() const {
+        uint64_t entries = 0;
+        for(uint32_t i = 0; i < m_shards.size(); ++i) {
+            boost::mutex::scoped_lock lock(m_shards[i]->mutex);
+            entries += m_shards[i]->cache.Size();
+        }
+        return entries;
+    }
+
+private:
+    struct CacheShard : boost::noncopyable {
+        explicit CacheShard(const unsigned capacity) :
+            cache(capacity),
+            check_sum(0),
+            hits(0),
+            misses(0)
+        { }
+        mutable boost::mutex mutex;
+        LRUCache<uint64_t, PhantomNode> cache;
+        unsigned check_sum;
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    //entries computed on another data set must not be handed out
+    inline void InvalidateOnNewData(CacheShard & shard, const unsigned check_sum) const {
+        if(shard.check_sum != check_sum) {
+            shard.cache.Clear();
+            shard.check_sum = check_sum;
+        }
+    }
+
+    //packs quantized lat (28 bits), lon (29 bits) and zoom level (5 bits)
+    inline uint64_t GetKey(
+        const FixedPointCoordinate & coordinate,
+        const unsigned zoom_level
+    ) const {
+        BOOST_ASSERT(coordinate.isValid());
+        const uint64_t lat =
+            (int64_t(coordinate.lat) + int64_t(90*COORDINATE_PRECISION))/m_resolution;
+        const uint64_t lon =
+            (int64_t(coordinate.lon) + int64_t(180*COORDINATE_PRECISION))/m_resolution;
+        return (lat << 34) | (lon << 5) | std::min(zoom_level, 31u);
+    }
+
+    inline CacheShard & GetShard(const uint64_t key) const {
+        const uint64_t mixed_key = (key ^ (key >> 34)) >> 5;
+        return *m_shards[mixed_key % m_shards.size()];
+    }
+
+    const unsigned m_resolution;
+    std::vector<CacheShard *> m_shards;
+};
+
+#endif /* PHANTOMNODECACHE_H_ */
@@ -58,6 +58,31 @@ struct PhantomNode {
     }
 };
 
+//Admits only segments whose bearing deviates at most 'range' degrees from
+//'bearing'. The default filter admits every segment.
+struct BearingFilter {
+    BearingFilter() : bearing(-1), range(180) { }
+    BearingFilter(const int b, const int r) : bearing(b), range(r) { }
+
+    int bearing;
+    int range;
+
+    bool IsActive() const {
+        return (0 <= bearing) && (range < 180);
+    }
+
+    bool Admits(const FixedPointCoordinate & source, const FixedPointCoordinate & target) const {
+        if(!IsActive()) {
+            return true;
+        }
+        double deviation = std::fabs(ComputeBearing(source, target) - bearing);
+        if(deviation > 180.) {
+            deviation = 360. - deviation;
+        }
+        return deviation <= range;
+    }
+};
+
 struct PhantomNodes {
     PhantomNode startPhantom;
     PhantomNode targetPhantom;
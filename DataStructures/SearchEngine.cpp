@@ -23,7 +23,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 SearchEngine::SearchEngine(
     QueryGraph * g,
     NodeInformationHelpDesk * nh,
-    std::vector<std::string> & n
+    const NameTable & n
     ) :
         _queryData(g, nh, n),
         shortestPath(_queryData),
@@ -35,18 +35,19 @@ void SearchEngine::GetCoordinatesForNodeID(
     NodeID id,
     FixedPointCoordinate& result
     ) const {
-    result.lat = _queryData.nodeHelpDesk->getLatitudeOfNode(id);
-    result.lon = _queryData.nodeHelpDesk->getLongitudeOfNode(id);
+    result = _queryData.nodeHelpDesk->getCoordinateOfNode(id);
 }
 
 void SearchEngine::FindPhantomNodeForCoordinate(
     const FixedPointCoordinate & location,
     PhantomNode & result,
-    const unsigned zoomLevel
+    const unsigned zoomLevel,
+    const BearingFilter & bearingFilter
     ) const {
     _queryData.nodeHelpDesk->FindPhantomNodeForCoordinate(
         location,
-        result, zoomLevel
+        result, zoomLevel,
+        bearingFilter
     );
 }
 
@@ -70,12 +71,7 @@ NodeID SearchEngine::GetNameIDForOriginDestinationNodeID(
 }
 
 std::string SearchEngine::GetEscapedNameForNameID(const unsigned nameID) const {
-    bool is_name_invalid = (nameID >= _queryData.names.size() || nameID == 0);
-    if (is_name_invalid) {
-        return std::string("");
-    }
-
-    return HTMLEntitize(_queryData.names.at(nameID));
+    return _queryData.names.GetEscapedName(nameID);
 }
 
 SearchEngineHeapPtr SearchEngineData::forwardHeap;
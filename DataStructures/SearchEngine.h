@@ -47,7 +47,7 @@ public:
     SearchEngine(
         QueryGraph * g,
         NodeInformationHelpDesk * nh,
-        std::vector<std::string> & n
+        const NameTable & n
     );
 	~SearchEngine();
 
@@ -56,13 +56,22 @@ public:
     void FindPhantomNodeForCoordinate(
         const FixedPointCoordinate & location,
         PhantomNode & result,
-        unsigned zoomLevel
+        unsigned zoomLevel,
+        const BearingFilter & bearingFilter = BearingFilter()
     ) const;
 
     NodeID GetNameIDForOriginDestinationNodeID(
         const NodeID s, const NodeID t) const;
 
     std::string GetEscapedNameForNameID(const unsigned nameID) const;
+
+    //appends the name without a temporary copy, names are stored escaped
+    inline void AppendEscapedNameForNameID(
+        const unsigned nameID,
+        std::string & output
+    ) const {
+        _queryData.names.AppendEscapedName(nameID, output);
+    }
 };
 
 #endif /* SEARCHENGINE_H_ */
@@ -19,6 +19,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
  */
 
 #include "BinaryHeap.h"
+#include "NameTable.h"
 #include "QueryEdge.h"
 #include "NodeInformationHelpDesk.h"
 #include "StaticGraph.h"
@@ -41,10 +42,10 @@ typedef boost::thread_specific_ptr<QueryHeapType> SearchEngineHeapPtr;
 struct SearchEngineData {
     typedef QueryGraph Graph;
     typedef QueryHeapType QueryHeap;
-    SearchEngineData(QueryGraph * g, NodeInformationHelpDesk * nh, std::vector<std::string> & n) :graph(g), nodeHelpDesk(nh), names(n) {}
+    SearchEngineData(QueryGraph * g, NodeInformationHelpDesk * nh, const NameTable & n) :graph(g), nodeHelpDesk(nh), names(n) {}
     const QueryGraph * graph;
     NodeInformationHelpDesk * nodeHelpDesk;
-    std::vector<std::string> & names;
+    const NameTable & names;
     static SearchEngineHeapPtr forwardHeap;
     static SearchEngineHeapPtr backwardHeap;
     static SearchEngineHeapPtr forwardHeap2;
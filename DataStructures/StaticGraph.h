@@ -21,14 +21,17 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #ifndef STATICGRAPH_H_INCLUDED
 #define STATICGRAPH_H_INCLUDED
 
+#include "../Util/MemoryPlacement.h"
 #include "../Util/SimpleLogger.h"
 #include "../typedefs.h"
 
+#include <boost/noncopyable.hpp>
+
 #include <algorithm>
 #include <vector>
 
 template< typename EdgeDataT>
-class StaticGraph {
+class StaticGraph : boost::noncopyable {
 public:
     typedef NodeID NodeIterator;
     typedef NodeID EdgeIterator;
@@ -79,6 +82,7 @@ public:
                 edge++;
             }
         }
+        SetArrays();
     }
 
     StaticGraph( std::vector<_StrNode> & nodes, std::vector<_StrEdge> & edges) {
@@ -90,6 +94,7 @@ public:
 
         //Add dummy node to end of _nodes array;
         _nodes.push_back(_nodes.back());
+        SetArrays();
 
 #ifndef NDEBUG
         Percent p(GetNumberOfNodes());
@@ -120,6 +125,22 @@ public:
 #endif
     }
 
+    //Views arrays that live elsewhere, e.g. in a mapped file, without
+    //copying them. nodes holds number_of_nodes+1 entries, the last one ends
+    //the edges of the last node. The arrays have to outlive the graph and
+    //its edge data must not be modified.
+    StaticGraph(
+        const _StrNode * nodes,
+        const unsigned number_of_nodes,
+        const _StrEdge * edges,
+        const unsigned number_of_edges
+    ) :
+        _numNodes(number_of_nodes),
+        _numEdges(number_of_edges),
+        nodeArray(nodes),
+        edgeArray(const_cast<_StrEdge *>(edges))
+    { }
+
     unsigned GetNumberOfNodes() const {
         return _numNodes;
     }
@@ -133,23 +154,23 @@ public:
     }
 
     inline NodeIterator GetTarget( const EdgeIterator &e ) const {
-        return NodeIterator( _edges[e].target );
+        return NodeIterator( edgeArray[e].target );
     }
 
     inline EdgeDataT &GetEdgeData( const EdgeIterator &e ) {
-        return _edges[e].data;
+        return edgeArray[e].data;
     }
 
     const EdgeDataT &GetEdgeData( const EdgeIterator &e ) const {
-        return _edges[e].data;
+        return edgeArray[e].data;
     }
 
     EdgeIterator BeginEdges( const NodeIterator &n ) const {
-        return EdgeIterator( _nodes[n].firstEdge );
+        return EdgeIterator( nodeArray[n].firstEdge );
     }
 
     EdgeIterator EndEdges( const NodeIterator &n ) const {
-        return EdgeIterator( _nodes[n+1].firstEdge );
+        return EdgeIterator( nodeArray[n+1].firstEdge );
     }
 
     //searches for a specific edge
@@ -171,6 +192,11 @@ public:
         return (UINT_MAX != tmp ? tmp : FindEdge( to, from ));
     }
 
+    void AdviseHugePages() const {
+        ::AdviseHugePages(nodeArray, uint64_t(_numNodes+1)*sizeof(_StrNode));
+        ::AdviseHugePages(edgeArray, uint64_t(_numEdges)*sizeof(_StrEdge));
+    }
+
     EdgeIterator FindEdgeIndicateIfReverse( const NodeIterator &from, const NodeIterator &to, bool & result ) const {
         EdgeIterator tmp =  FindEdge( from, to );
         if(UINT_MAX == tmp) {
@@ -182,12 +208,19 @@ public:
     }
 
 private:
+    void SetArrays() {
+        nodeArray = _nodes.empty() ? NULL : &_nodes[0];
+        edgeArray = _edges.empty() ? NULL : &_edges[0];
+    }
 
     NodeIterator _numNodes;
     EdgeIterator _numEdges;
 
     std::vector< _StrNode > _nodes;
     std::vector< _StrEdge > _edges;
+    //point into the vectors or into memory that is only viewed
+    const _StrNode * nodeArray;
+    _StrEdge * edgeArray;
 };
 
 #endif // STATICGRAPH_H_INCLUDED
@@ -26,6 +26,9 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #include "PhantomNodes.h"
 #include "DeallocatingVector.h"
 #include "HilbertValue.h"
+#include "LeafGridIndex.h"
+#include "../Util/FileLoader.h"
+#include "../Util/MemoryPlacement.h"
 #include "../Util/OSRMException.h"
 #include "../Util/SimpleLogger.h"
 #include "../Util/TimingUtil.h"
@@ -36,6 +39,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/atomic.hpp>
 #include <boost/algorithm/minmax.hpp>
 #include <boost/algorithm/minmax_element.hpp>
 #include <boost/range/algorithm_ext/erase.hpp>
@@ -45,6 +49,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #include <cassert>
 #include <cfloat>
 #include <climits>
+#include <cstring>
 
 #include <algorithm>
 #include <queue>
@@ -55,9 +60,25 @@ or see http://www.gnu.org/licenses/agpl.txt.
 const static uint32_t RTREE_BRANCHING_FACTOR = 50;
 const static uint32_t RTREE_LEAF_NODE_SIZE = 1170;
 
+//worst case size of a compressed leaf element: four 32 bit coordinates and
+//three 5 byte varints for id, name id and weight plus flags
+const static uint32_t RTREE_MAX_COMPRESSED_ELEMENT_SIZE = 4*4 + 3*5;
+
 // Implements a static, i.e. packed, R-tree
 
-static boost::thread_specific_ptr<boost::filesystem::ifstream> thread_local_rtree_stream;
+//leaf file of the tree a thread read last, a reloaded data set brings a
+//new tree whose leafs may live in another file under the same name
+struct RTreeLeafStream {
+    explicit RTreeLeafStream(const uint64_t id) : rtree_id(id) { }
+    boost::filesystem::ifstream stream;
+    const uint64_t rtree_id;
+};
+static boost::thread_specific_ptr<RTreeLeafStream> thread_local_rtree_stream;
+
+inline uint64_t GetNextRTreeID() {
+    static boost::atomic<uint64_t> next_rtree_id(0);
+    return ++next_rtree_id;
+}
 
 template<class DataT>
 class StaticRTree : boost::noncopyable {
@@ -255,6 +276,156 @@ private:
         DataT objects[RTREE_LEAF_NODE_SIZE];
     };
 
+    //Leafs are stored compressed on disk. Coordinates are offsets to the lower
+    //left corner of the leaf's MBR, stored with 16 bits whenever the MBR is
+    //small enough and with 32 bits otherwise. IDs, name IDs and weights are
+    //zig-zag encoded deltas to the previous element written as varints.
+    struct CompressedLeafHeader {
+        uint32_t object_count;
+        int32_t min_lat;
+        int32_t min_lon;
+        uint32_t coordinate_width;
+    };
+
+    struct CompressedLeafNode {
+        CompressedLeafNode() { header.object_count = 0; }
+        CompressedLeafHeader header;
+        unsigned char data[RTREE_LEAF_NODE_SIZE*RTREE_MAX_COMPRESSED_ELEMENT_SIZE];
+    };
+
+    static inline uint32_t ZigZagEncode(const uint32_t delta) {
+        return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+    }
+
+    static inline uint32_t ZigZagDecode(const uint32_t value) {
+        return (value >> 1) ^ (0 - (value & 1));
+    }
+
+    static inline void WriteVarInt(uint64_t value, std::vector<unsigned char> & buffer) {
+        while(value >= 0x80) {
+            buffer.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<unsigned char>(value));
+    }
+
+    static inline uint64_t ReadVarInt(const unsigned char * & cursor) {
+        uint64_t value = *cursor & 0x7f;
+        unsigned shift = 7;
+        while(*cursor++ & 0x80) {
+            value |= static_cast<uint64_t>(*cursor & 0x7f) << shift;
+            shift += 7;
+        }
+        return value;
+    }
+
+    static inline void WriteOffset(
+        const uint32_t offset,
+        const uint32_t width,
+        std::vector<unsigned char> & buffer
+    ) {
+        for(uint32_t i = 0; i < width; ++i) {
+            buffer.push_back(static_cast<unsigned char>(offset >> (8*i)));
+        }
+    }
+
+    static inline uint32_t ReadOffset(
+        const unsigned char * & cursor,
+        const uint32_t width
+    ) {
+        uint32_t offset = cursor[0] | (cursor[1] << 8);
+        if(4 == width) {
+            offset |= (cursor[2] << 16) | (static_cast<uint32_t>(cursor[3]) << 24);
+        }
+        cursor += width;
+        return offset;
+    }
+
+    static void EncodeLeaf(
+        const LeafNode & leaf,
+        const RectangleT & mbr,
+        std::vector<unsigned char> & buffer
+    ) {
+        CompressedLeafHeader header;
+        header.object_count = leaf.object_count;
+        header.min_lat = mbr.min_lat;
+        header.min_lon = mbr.min_lon;
+        const bool fits_into_16_bits =
+            (static_cast<int64_t>(mbr.max_lat) - mbr.min_lat) <= USHRT_MAX &&
+            (static_cast<int64_t>(mbr.max_lon) - mbr.min_lon) <= USHRT_MAX;
+        header.coordinate_width = (fits_into_16_bits ? 2 : 4);
+
+        buffer.clear();
+        buffer.insert(
+            buffer.end(),
+            (unsigned char*)&header,
+            (unsigned char*)&header + sizeof(CompressedLeafHeader)
+        );
+        uint32_t previous_id = 0;
+        uint32_t previous_name_id = 0;
+        for(uint32_t i = 0; i < leaf.object_count; ++i) {
+            const DataT & object = leaf.objects[i];
+            WriteOffset(object.lat1 - header.min_lat, header.coordinate_width, buffer);
+            WriteOffset(object.lon1 - header.min_lon, header.coordinate_width, buffer);
+            WriteOffset(object.lat2 - header.min_lat, header.coordinate_width, buffer);
+            WriteOffset(object.lon2 - header.min_lon, header.coordinate_width, buffer);
+            WriteVarInt(ZigZagEncode(object.id - previous_id), buffer);
+            WriteVarInt(ZigZagEncode(object.nameID - previous_name_id), buffer);
+            const uint64_t weight_and_flags =
+                (static_cast<uint64_t>(object.weight) << 2) |
+                (object.belongsToTinyComponent ? 2 : 0) |
+                (object.ignoreInGrid ? 1 : 0);
+            WriteVarInt(weight_and_flags, buffer);
+            previous_id = object.id;
+            previous_name_id = object.nameID;
+        }
+        BOOST_ASSERT_MSG(
+            buffer.size() <= sizeof(CompressedLeafNode),
+            "compressed leaf exceeds maximum size"
+        );
+    }
+
+    //Decodes the elements of a compressed leaf one after another, so that the
+    //leaf scan never needs to materialize the whole uncompressed leaf.
+    class LeafDecoder {
+    public:
+        explicit LeafDecoder(const CompressedLeafNode & leaf) :
+            m_header(leaf.header),
+            m_cursor(leaf.data),
+            m_remaining(leaf.header.object_count),
+            m_previous_id(0),
+            m_previous_name_id(0)
+        { }
+
+        inline bool Next(DataT & object) {
+            if(0 == m_remaining) {
+                return false;
+            }
+            --m_remaining;
+            const uint32_t width = m_header.coordinate_width;
+            object.lat1 = m_header.min_lat + ReadOffset(m_cursor, width);
+            object.lon1 = m_header.min_lon + ReadOffset(m_cursor, width);
+            object.lat2 = m_header.min_lat + ReadOffset(m_cursor, width);
+            object.lon2 = m_header.min_lon + ReadOffset(m_cursor, width);
+            m_previous_id += ZigZagDecode(ReadVarInt(m_cursor));
+            m_previous_name_id += ZigZagDecode(ReadVarInt(m_cursor));
+            object.id = m_previous_id;
+            object.nameID = m_previous_name_id;
+            const uint64_t weight_and_flags = ReadVarInt(m_cursor);
+            object.weight = static_cast<uint32_t>(weight_and_flags >> 2);
+            object.belongsToTinyComponent = (weight_and_flags & 2);
+            object.ignoreInGrid = (weight_and_flags & 1);
+            return true;
+        }
+
+    private:
+        const CompressedLeafHeader m_header;
+        const unsigned char * m_cursor;
+        uint32_t m_remaining;
+        uint32_t m_previous_id;
+        uint32_t m_previous_name_id;
+    };
+
     struct TreeNode {
         TreeNode() : child_count(0), child_is_on_disk(false) {}
         RectangleT minimum_bounding_rectangle;
@@ -276,19 +447,56 @@ private:
         }
     };
 
+    //State of a nearest edge search that is carried across scanned leafs
+    struct NearestEdgeCandidate {
+        NearestEdgeCandidate(
+            const bool ignore_tiny_components,
+            const BearingFilter & bearing_filter
+        ) :
+            ignore_tiny_components(ignore_tiny_components),
+            bearing_filter(bearing_filter),
+            min_dist(DBL_MAX),
+            found_a_nearest_edge(false)
+        { }
+        bool ignore_tiny_components;
+        BearingFilter bearing_filter;
+        double min_dist;
+        bool found_a_nearest_edge;
+        PhantomNode phantom_node;
+        FixedPointCoordinate start_coordinate;
+        FixedPointCoordinate end_coordinate;
+    };
+
     std::vector<TreeNode> m_search_tree;
+    std::vector<uint64_t> m_leaf_offsets;
+    //point into the vectors or into memory that is only viewed
+    const TreeNode * m_tree_nodes;
+    const uint64_t * m_leaf_offset_array;
+    uint32_t m_number_of_leaf_offsets;
     uint64_t m_element_count;
+    LeafGridIndex * m_grid_index;
 
     const std::string m_leaf_node_filename;
+    //bytes of the leaf file if it is in memory, NULL if it is read from disk
+    const char * m_leaf_data;
+    const uint64_t m_rtree_id;
 public:
     //Construct a packed Hilbert-R-Tree with Kamel-Faloutsos algorithm [1]
+    //and, if a file name is given, the grid index in front of it
     explicit StaticRTree(
         std::vector<DataT> & input_data_vector,
         const std::string tree_node_filename,
-        const std::string leaf_node_filename
+        const std::string leaf_node_filename,
+        const std::string grid_filename = ""
     )
-     :  m_element_count(input_data_vector.size()),
-        m_leaf_node_filename(leaf_node_filename)
+     :  m_tree_nodes(NULL),
+        m_leaf_offset_array(NULL),
+        m_number_of_leaf_offsets(0),
+        m_element_count(input_data_vector.size()),
+        m_grid_index(NULL),
+        m_leaf_node_filename(leaf_node_filename),
+        m_leaf_data(NULL),
+        m_rtree_id(GetNextRTreeID())
     {
         SimpleLogger().Write() <<
             "constructing r-tree of " << m_element_count <<
@@ -320,6 +528,9 @@ public:
 
         //pack M elements into leaf node and write to leaf file
         uint64_t processed_objects_count = 0;
+        uint64_t leaf_file_offset = sizeof(uint64_t);
+        std::vector<unsigned char> compressed_leaf;
+        std::vector<RectangleT> leaf_rectangles;
         while(processed_objects_count < m_element_count) {
 
             LeafNode current_leaf;
@@ -337,14 +548,33 @@ public:
             current_node.child_is_on_disk = true;
             current_node.children[0] = tree_nodes_in_level.size();
             tree_nodes_in_level.push_back(current_node);
+            leaf_rectangles.push_back(current_node.minimum_bounding_rectangle);
 
-            //write leaf_node to leaf node file
-            leaf_node_file.write((char*)&current_leaf, sizeof(current_leaf));
+            //compress leaf_node and write it to leaf node file
+            EncodeLeaf(
+                current_leaf,
+                current_node.minimum_bounding_rectangle,
+                compressed_leaf
+            );
+            m_leaf_offsets.push_back(leaf_file_offset);
+            leaf_node_file.write((char*)&compressed_leaf[0], compressed_leaf.size());
+            leaf_file_offset += compressed_leaf.size();
             processed_objects_count += current_leaf.object_count;
         }
+        //sentinel to derive the size of the last leaf
+        m_leaf_offsets.push_back(leaf_file_offset);
 
         //close leaf file
         leaf_node_file.close();
+        SimpleLogger().Write() <<
+            "wrote " << (m_leaf_offsets.size()-1) << " compressed leafs in " <<
+            leaf_file_offset << " bytes, " <<
+            (leaf_file_offset/std::max(m_element_count, (uint64_t)1)) <<
+            " bytes per element";
+
+        if(!grid_filename.empty()) {
+            LeafGridIndex::Build(leaf_rectangles, grid_filename);
+        }
 
         uint32_t processing_level = 0;
         while(1 < tree_nodes_in_level.size()) {
@@ -401,6 +631,10 @@ public:
         BOOST_ASSERT_MSG(0 < size_of_tree, "tree empty");
         tree_node_file.write((char *)&size_of_tree, sizeof(uint32_t));
         tree_node_file.write((char *)&m_search_tree[0], sizeof(TreeNode)*size_of_tree);
+        //leaf offsets into the leaf file, including the end sentinel
+        uint32_t number_of_leaf_offsets = m_leaf_offsets.size();
+        tree_node_file.write((char *)&number_of_leaf_offsets, sizeof(uint32_t));
+        tree_node_file.write((char *)&m_leaf_offsets[0], sizeof(uint64_t)*number_of_leaf_offsets);
         //close tree node file.
         tree_node_file.close();
         double time2 = get_timestamp();
@@ -408,12 +642,77 @@ public:
             "finished r-tree construction in " << (time2-time1) << " seconds";
     }
 
-    //Read-only operation for queries
+    typedef TreeNode SearchTreeNode;
+
+    //Read-only operation for queries, the grid index is optional
     explicit StaticRTree(
             const std::string & node_filename,
-            const std::string & leaf_filename
-    ) : m_leaf_node_filename(leaf_filename) {
-        //open tree node file and load into RAM.
+            const std::string & leaf_filename,
+            const std::string & grid_filename = ""
+    ) :
+        m_grid_index(NULL),
+        m_leaf_node_filename(leaf_filename),
+        m_leaf_data(NULL),
+        m_rtree_id(GetNextRTreeID())
+    {
+        LoadSearchTree(node_filename, m_search_tree, m_leaf_offsets);
+        m_tree_nodes = &m_search_tree[0];
+        m_leaf_offset_array = &m_leaf_offsets[0];
+        m_number_of_leaf_offsets = m_leaf_offsets.size();
+        OpenLeafAndGridFiles(leaf_filename, grid_filename);
+    }
+
+    //Views a search tree that was loaded elsewhere, e.g. into shared memory.
+    //The arrays have to outlive the tree.
+    StaticRTree(
+            const TreeNode * tree_nodes,
+            const uint64_t * leaf_offsets,
+            const uint32_t number_of_leaf_offsets,
+            const std::string & leaf_filename,
+            const std::string & grid_filename = ""
+    ) :
+        m_tree_nodes(tree_nodes),
+        m_leaf_offset_array(leaf_offsets),
+        m_number_of_leaf_offsets(number_of_leaf_offsets),
+        m_grid_index(NULL),
+        m_leaf_node_filename(leaf_filename),
+        m_leaf_data(NULL),
+        m_rtree_id(GetNextRTreeID())
+    {
+        OpenLeafAndGridFiles(leaf_filename, grid_filename);
+    }
+
+    //Views a search tree whose leafs are in memory as well, e.g. in a mapped
+    //dataset container. Takes ownership of the optional grid index.
+    StaticRTree(
+            const TreeNode * tree_nodes,
+            const uint64_t * leaf_offsets,
+            const uint32_t number_of_leaf_offsets,
+            const char * leaf_data,
+            LeafGridIndex * grid_index
+    ) :
+        m_tree_nodes(tree_nodes),
+        m_leaf_offset_array(leaf_offsets),
+        m_number_of_leaf_offsets(number_of_leaf_offsets),
+        m_element_count(*reinterpret_cast<const uint64_t *>(leaf_data)),
+        m_grid_index(grid_index),
+        m_leaf_data(leaf_data),
+        m_rtree_id(GetNextRTreeID())
+    { }
+
+    //Only covers a search tree that was read into the tree's own memory
+    void AdviseHugePages() const {
+        if( !m_search_tree.empty() ) {
+            ::AdviseHugePages(&m_search_tree[0], m_search_tree.size()*sizeof(TreeNode));
+        }
+    }
+
+    //Reads the inner nodes and leaf offsets from the ram index file
+    static void LoadSearchTree(
+        const std::string & node_filename,
+        std::vector<TreeNode> & search_tree,
+        std::vector<uint64_t> & leaf_offsets
+    ) {
         boost::filesystem::path node_file(node_filename);
 
         if ( !boost::filesystem::exists( node_file ) ) {
@@ -426,11 +725,41 @@ public:
 
         uint32_t tree_size = 0;
         tree_node_file.read((char*)&tree_size, sizeof(uint32_t));
-        //SimpleLogger().Write() << "reading " << tree_size << " tree nodes in " << (sizeof(TreeNode)*tree_size) << " bytes";
-        m_search_tree.resize(tree_size);
-        tree_node_file.read((char*)&m_search_tree[0], sizeof(TreeNode)*tree_size);
+        const uint64_t leaf_offsets_position =
+            sizeof(uint32_t) + uint64_t(tree_size)*sizeof(TreeNode);
+        tree_node_file.seekg(leaf_offsets_position);
+        uint32_t number_of_leaf_offsets = 0;
+        tree_node_file.read((char*)&number_of_leaf_offsets, sizeof(uint32_t));
+        if( 2 > number_of_leaf_offsets || !tree_node_file.good() ) {
+            throw OSRMException("ram index file misses leaf offsets, reprocess data");
+        }
         tree_node_file.close();
 
+        search_tree.resize(tree_size);
+        ReadFileRange(
+            node_filename,
+            sizeof(uint32_t),
+            (char*)&search_tree[0],
+            uint64_t(tree_size)*sizeof(TreeNode)
+        );
+        leaf_offsets.resize(number_of_leaf_offsets);
+        ReadFileRange(
+            node_filename,
+            leaf_offsets_position + sizeof(uint32_t),
+            (char*)&leaf_offsets[0],
+            uint64_t(number_of_leaf_offsets)*sizeof(uint64_t)
+        );
+    }
+
+    ~StaticRTree() {
+        delete m_grid_index;
+    }
+
+private:
+    void OpenLeafAndGridFiles(
+        const std::string & leaf_filename,
+        const std::string & grid_filename
+    ) {
         //open leaf node file and store thread specific pointer
         boost::filesystem::path leaf_file(leaf_filename);
         if ( !boost::filesystem::exists( leaf_file ) ) {
@@ -439,14 +768,25 @@ public:
         if ( 0 == boost::filesystem::file_size( leaf_file ) ) {
             throw OSRMException("mem index file is empty");
         }
+        //leafs are read at query time, a short file would fail mid-traffic
+        if ( boost::filesystem::file_size( leaf_file ) <
+             m_leaf_offset_array[m_number_of_leaf_offsets-1]
+        ) {
+            throw OSRMException("mem index file is truncated");
+        }
 
         boost::filesystem::ifstream leaf_node_file( leaf_file, std::ios::binary );
         leaf_node_file.read((char*)&m_element_count, sizeof(uint64_t));
         leaf_node_file.close();
 
-        //SimpleLogger().Write() << tree_size << " nodes in search tree";
+        if(!grid_filename.empty()) {
+            m_grid_index = new LeafGridIndex(grid_filename);
+        }
+
         //SimpleLogger().Write() << m_element_count << " elements in leafs";
     }
+
+public:
 /*
     inline void FindKNearestPhantomNodesForCoordinate(
         const FixedPointCoordinate & location,
@@ -469,7 +809,7 @@ public:
 
         //initialize queue with root element
         std::priority_queue<QueryCandidate> traversal_queue;
-        traversal_queue.push(QueryCandidate(0, m_search_tree[0].minimum_bounding_rectangle.GetMinDist(input_coordinate)));
+        traversal_queue.push(QueryCandidate(0, m_tree_nodes[0].minimum_bounding_rectangle.GetMinDist(input_coordinate)));
         BOOST_ASSERT_MSG(FLT_EPSILON > (0. - traversal_queue.top().min_dist), "Root element in NN Search has min dist != 0.");
 
         while(!traversal_queue.empty()) {
@@ -479,7 +819,7 @@ public:
             bool prune_downward = (current_query_node.min_dist >= min_max_dist);
             bool prune_upward    = (current_query_node.min_dist >= min_dist);
             if( !prune_downward && !prune_upward ) { //downward pruning
-                TreeNode & current_tree_node = m_search_tree[current_query_node.node_id];
+                const TreeNode & current_tree_node = m_tree_nodes[current_query_node.node_id];
                 if (current_tree_node.child_is_on_disk) {
                     LeafNode current_leaf_node;
                     LoadLeafFromDisk(current_tree_node.children[0], current_leaf_node);
@@ -542,7 +882,7 @@ public:
                     //traverse children, prune if global mindist is smaller than local one
                     for (uint32_t i = 0; i < current_tree_node.child_count; ++i) {
                         const int32_t child_id = current_tree_node.children[i];
-                        TreeNode & child_tree_node = m_search_tree[child_id];
+                        const TreeNode & child_tree_node = m_tree_nodes[child_id];
                         RectangleT & child_rectangle = child_tree_node.minimum_bounding_rectangle;
                         const double current_min_dist = child_rectangle.GetMinDist(input_coordinate);
                         const double current_min_max_dist = child_rectangle.GetMinMaxDist(input_coordinate);
@@ -598,24 +938,92 @@ public:
     bool FindPhantomNodeForCoordinate(
             const FixedPointCoordinate & input_coordinate,
             PhantomNode & result_phantom_node,
-            const unsigned zoom_level
+            const unsigned zoom_level,
+            const BearingFilter & bearing_filter = BearingFilter()
     ) {
+        const bool ignore_tiny_components = (zoom_level <= 14);
+        //SimpleLogger().Write() << "searching for coordinate " << input_coordinate;
 
-        bool ignore_tiny_components = (zoom_level <= 14);
-        DataT nearest_edge;
+        NearestEdgeCandidate candidate(ignore_tiny_components, bearing_filter);
+        if(!FindNearestEdgeInGrid(input_coordinate, candidate)) {
+            candidate = NearestEdgeCandidate(ignore_tiny_components, bearing_filter);
+            FindNearestEdgeInTree(input_coordinate, candidate);
+        }
+        result_phantom_node = candidate.phantom_node;
+
+        const double ratio = (candidate.found_a_nearest_edge ?
+            std::min(1., ApproximateDistance(candidate.start_coordinate,
+                result_phantom_node.location)/ApproximateDistance(candidate.start_coordinate, candidate.end_coordinate)
+                ) : 0
+            );
+        result_phantom_node.weight1 *= ratio;
+        if(INT_MAX != result_phantom_node.weight2) {
+            result_phantom_node.weight2 *= (1.-ratio);
+        }
+        result_phantom_node.ratio = ratio;
 
+        //Hack to fix rounding errors and wandering via nodes.
+        if(std::abs(input_coordinate.lon - result_phantom_node.location.lon) == 1) {
+            result_phantom_node.location.lon = input_coordinate.lon;
+        }
+        if(std::abs(input_coordinate.lat - result_phantom_node.location.lat) == 1) {
+            result_phantom_node.location.lat = input_coordinate.lat;
+        }
+
+        return candidate.found_a_nearest_edge;
+
+    }
+private:
+    //Answers the query from the leafs listed in the grid cell of the input
+    //coordinate. Fails if the cell is not gridded or if a closer segment might
+    //exist outside of the cell, i.e. in a leaf that is not listed.
+    inline bool FindNearestEdgeInGrid(
+            const FixedPointCoordinate & input_coordinate,
+            NearestEdgeCandidate & candidate
+    ) {
+        if(NULL == m_grid_index) {
+            return false;
+        }
+        const uint32_t * leaf_ids = NULL;
+        uint32_t leaf_count = 0;
+        LeafGridIndex::CellBounds cell_bounds;
+        if(!m_grid_index->FindLeafsForCoordinate(input_coordinate, leaf_ids, leaf_count, cell_bounds)) {
+            return false;
+        }
+        for(uint32_t i = 0; i < leaf_count; ++i) {
+            ScanLeaf(leaf_ids[i], input_coordinate, candidate);
+        }
+        if(!candidate.found_a_nearest_edge) {
+            return false;
+        }
+        const double distance_to_cell_border = std::min(
+            std::min(
+                input_coordinate.lat - cell_bounds.min_lat,
+                cell_bounds.max_lat - input_coordinate.lat
+            ),
+            std::min(
+                input_coordinate.lon - cell_bounds.min_lon,
+                cell_bounds.max_lon - input_coordinate.lon
+            )
+        );
+        //perpendicular distances are squared
+        return candidate.min_dist < distance_to_cell_border*distance_to_cell_border;
+    }
+
+    inline void FindNearestEdgeInTree(
+            const FixedPointCoordinate & input_coordinate,
+            NearestEdgeCandidate & candidate
+    ) {
+        //a filtered search must not prune by the farthest distance to a
+        //rectangle, since the segment on its border may not be admitted
+        const bool use_min_max_pruning = !candidate.bearing_filter.IsActive();
         uint32_t io_count = 0;
         uint32_t explored_tree_nodes_count = 0;
-        //SimpleLogger().Write() << "searching for coordinate " << input_coordinate;
-        double min_dist = DBL_MAX;
         double min_max_dist = DBL_MAX;
-        bool found_a_nearest_edge = false;
-
-        FixedPointCoordinate nearest, current_start_coordinate, current_end_coordinate;
 
         //initialize queue with root element
         std::priority_queue<QueryCandidate> traversal_queue;
-        double current_min_dist = m_search_tree[0].minimum_bounding_rectangle.GetMinDist(input_coordinate);
+        double current_min_dist = m_tree_nodes[0].minimum_bounding_rectangle.GetMinDist(input_coordinate);
         traversal_queue.push(
                              QueryCandidate(0, current_min_dist)
         );
@@ -630,94 +1038,31 @@ public:
 
             ++explored_tree_nodes_count;
             bool prune_downward = (current_query_node.min_dist >= min_max_dist);
-            bool prune_upward    = (current_query_node.min_dist >= min_dist);
+            bool prune_upward    = (current_query_node.min_dist >= candidate.min_dist);
             if( !prune_downward && !prune_upward ) { //downward pruning
-                TreeNode & current_tree_node = m_search_tree[current_query_node.node_id];
+                const TreeNode & current_tree_node = m_tree_nodes[current_query_node.node_id];
                 if (current_tree_node.child_is_on_disk) {
-                    LeafNode current_leaf_node;
-                    LoadLeafFromDisk(current_tree_node.children[0], current_leaf_node);
+                    ScanLeaf(
+                        current_tree_node.children[0],
+                        input_coordinate,
+                        candidate
+                    );
                     ++io_count;
-                    //SimpleLogger().Write() << "checking " << current_leaf_node.object_count << " elements";
-                    for(uint32_t i = 0; i < current_leaf_node.object_count; ++i) {
-                        DataT & current_edge = current_leaf_node.objects[i];
-                        if(ignore_tiny_components && current_edge.belongsToTinyComponent) {
-                            continue;
-                        }
-                        if(current_edge.isIgnored()) {
-                            continue;
-                        }
-
-                       double current_ratio = 0.;
-                       double current_perpendicular_distance = ComputePerpendicularDistance(
-                                input_coordinate,
-                                FixedPointCoordinate(current_edge.lat1, current_edge.lon1),
-                                FixedPointCoordinate(current_edge.lat2, current_edge.lon2),
-                                nearest,
-                                &current_ratio
-                        );
-
-                        if(
-                                current_perpendicular_distance < min_dist
-                                && !DoubleEpsilonCompare(
-                                        current_perpendicular_distance,
-                                        min_dist
-                                )
-                        ) { //found a new minimum
-                            min_dist = current_perpendicular_distance;
-                            result_phantom_node.edgeBasedNode = current_edge.id;
-                            result_phantom_node.nodeBasedEdgeNameID = current_edge.nameID;
-                            result_phantom_node.weight1 = current_edge.weight;
-                            result_phantom_node.weight2 = INT_MAX;
-                            result_phantom_node.location = nearest;
-                            current_start_coordinate.lat = current_edge.lat1;
-                            current_start_coordinate.lon = current_edge.lon1;
-                            current_end_coordinate.lat = current_edge.lat2;
-                            current_end_coordinate.lon = current_edge.lon2;
-                            nearest_edge = current_edge;
-                            found_a_nearest_edge = true;
-                        } else if(
-                                DoubleEpsilonCompare(current_perpendicular_distance, min_dist) &&
-                                1 == abs(current_edge.id - result_phantom_node.edgeBasedNode )
-                        && CoordinatesAreEquivalent(
-                                current_start_coordinate,
-                                FixedPointCoordinate(
-                                        current_edge.lat1,
-                                        current_edge.lon1
-                                ),
-                                FixedPointCoordinate(
-                                        current_edge.lat2,
-                                        current_edge.lon2
-                                ),
-                                current_end_coordinate
-                            )
-                        ) {
-                            BOOST_ASSERT_MSG(current_edge.id != result_phantom_node.edgeBasedNode, "IDs not different");
-                            //SimpleLogger().Write() << "found bidirected edge on nodes " << current_edge.id << " and " << result_phantom_node.edgeBasedNode;
-                            result_phantom_node.weight2 = current_edge.weight;
-                            if(current_edge.id < result_phantom_node.edgeBasedNode) {
-                                result_phantom_node.edgeBasedNode = current_edge.id;
-                                std::swap(result_phantom_node.weight1, result_phantom_node.weight2);
-                                std::swap(current_end_coordinate, current_start_coordinate);
-                            //    SimpleLogger().Write() <<"case 2";
-                            }
-                            //SimpleLogger().Write() << "w1: " << result_phantom_node.weight1 << ", w2: " << result_phantom_node.weight2;
-                        }
-                    }
                 } else {
                     //traverse children, prune if global mindist is smaller than local one
                     for (uint32_t i = 0; i < current_tree_node.child_count; ++i) {
                         const int32_t child_id = current_tree_node.children[i];
-                        TreeNode & child_tree_node = m_search_tree[child_id];
-                        RectangleT & child_rectangle = child_tree_node.minimum_bounding_rectangle;
+                        const TreeNode & child_tree_node = m_tree_nodes[child_id];
+                        const RectangleT & child_rectangle = child_tree_node.minimum_bounding_rectangle;
                         const double current_min_dist = child_rectangle.GetMinDist(input_coordinate);
                         const double current_min_max_dist = child_rectangle.GetMinMaxDist(input_coordinate);
-                        if( current_min_max_dist < min_max_dist ) {
+                        if( use_min_max_pruning && current_min_max_dist < min_max_dist ) {
                             min_max_dist = current_min_max_dist;
                         }
                         if (current_min_dist > min_max_dist) {
                             continue;
                         }
-                        if (current_min_dist > min_dist) { //upward pruning
+                        if (current_min_dist > candidate.min_dist) { //upward pruning
                             continue;
                         }
                         traversal_queue.push(QueryCandidate(child_id, current_min_dist));
@@ -725,46 +1070,124 @@ public:
                 }
             }
         }
+    }
 
-        const double ratio = (found_a_nearest_edge ?
-            std::min(1., ApproximateDistance(current_start_coordinate,
-                result_phantom_node.location)/ApproximateDistance(current_start_coordinate, current_end_coordinate)
-                ) : 0
+    inline void ScanLeaf(
+            const uint32_t leaf_id,
+            const FixedPointCoordinate & input_coordinate,
+            NearestEdgeCandidate & candidate
+    ) {
+        CompressedLeafNode current_leaf_node;
+        LoadLeafFromDisk(leaf_id, current_leaf_node);
+        //SimpleLogger().Write() << "checking " << current_leaf_node.header.object_count << " elements";
+
+        PhantomNode & result_phantom_node = candidate.phantom_node;
+        FixedPointCoordinate nearest;
+        LeafDecoder leaf_decoder(current_leaf_node);
+        DataT current_edge;
+        while(leaf_decoder.Next(current_edge)) {
+            if(candidate.ignore_tiny_components && current_edge.belongsToTinyComponent) {
+                continue;
+            }
+            if(current_edge.isIgnored()) {
+                continue;
+            }
+
+            double current_ratio = 0.;
+            double current_perpendicular_distance = ComputePerpendicularDistance(
+                    input_coordinate,
+                    FixedPointCoordinate(current_edge.lat1, current_edge.lon1),
+                    FixedPointCoordinate(current_edge.lat2, current_edge.lon2),
+                    nearest,
+                    &current_ratio
             );
-        result_phantom_node.weight1 *= ratio;
-        if(INT_MAX != result_phantom_node.weight2) {
-            result_phantom_node.weight2 *= (1.-ratio);
-        }
-        result_phantom_node.ratio = ratio;
 
-        //Hack to fix rounding errors and wandering via nodes.
-        if(std::abs(input_coordinate.lon - result_phantom_node.location.lon) == 1) {
-            result_phantom_node.location.lon = input_coordinate.lon;
-        }
-        if(std::abs(input_coordinate.lat - result_phantom_node.location.lat) == 1) {
-            result_phantom_node.location.lat = input_coordinate.lat;
+            if(
+                    current_perpendicular_distance < candidate.min_dist
+                    && !DoubleEpsilonCompare(
+                            current_perpendicular_distance,
+                            candidate.min_dist
+                    )
+                    && candidate.bearing_filter.Admits(
+                            FixedPointCoordinate(current_edge.lat1, current_edge.lon1),
+                            FixedPointCoordinate(current_edge.lat2, current_edge.lon2)
+                    )
+            ) { //found a new minimum
+                candidate.min_dist = current_perpendicular_distance;
+                result_phantom_node.edgeBasedNode = current_edge.id;
+                result_phantom_node.nodeBasedEdgeNameID = current_edge.nameID;
+                result_phantom_node.weight1 = current_edge.weight;
+                result_phantom_node.weight2 = INT_MAX;
+                result_phantom_node.location = nearest;
+                candidate.start_coordinate.lat = current_edge.lat1;
+                candidate.start_coordinate.lon = current_edge.lon1;
+                candidate.end_coordinate.lat = current_edge.lat2;
+                candidate.end_coordinate.lon = current_edge.lon2;
+                candidate.found_a_nearest_edge = true;
+            } else if(
+                    DoubleEpsilonCompare(current_perpendicular_distance, candidate.min_dist) &&
+                    1 == std::abs(static_cast<int>(current_edge.id - result_phantom_node.edgeBasedNode))
+            && CoordinatesAreEquivalent(
+                    candidate.start_coordinate,
+                    FixedPointCoordinate(
+                            current_edge.lat1,
+                            current_edge.lon1
+                    ),
+                    FixedPointCoordinate(
+                            current_edge.lat2,
+                            current_edge.lon2
+                    ),
+                    candidate.end_coordinate
+                )
+            && candidate.bearing_filter.Admits(
+                    FixedPointCoordinate(current_edge.lat1, current_edge.lon1),
+                    FixedPointCoordinate(current_edge.lat2, current_edge.lon2)
+                )
+            ) {
+                BOOST_ASSERT_MSG(current_edge.id != result_phantom_node.edgeBasedNode, "IDs not different");
+                //SimpleLogger().Write() << "found bidirected edge on nodes " << current_edge.id << " and " << result_phantom_node.edgeBasedNode;
+                result_phantom_node.weight2 = current_edge.weight;
+                if(current_edge.id < result_phantom_node.edgeBasedNode) {
+                    result_phantom_node.edgeBasedNode = current_edge.id;
+                    std::swap(result_phantom_node.weight1, result_phantom_node.weight2);
+                    std::swap(candidate.end_coordinate, candidate.start_coordinate);
+                //    SimpleLogger().Write() <<"case 2";
+                }
+                //SimpleLogger().Write() << "w1: " << result_phantom_node.weight1 << ", w2: " << result_phantom_node.weight2;
+            }
         }
-
-        return found_a_nearest_edge;
-
     }
-private:
-    inline void LoadLeafFromDisk(const uint32_t leaf_id, LeafNode& result_node) {
-        if(!thread_local_rtree_stream.get() || !thread_local_rtree_stream->is_open()) {
-            thread_local_rtree_stream.reset(
-                new boost::filesystem::ifstream(
-                        m_leaf_node_filename,
-                        std::ios::in | std::ios::binary
-                )
+
+    inline void LoadLeafFromDisk(const uint32_t leaf_id, CompressedLeafNode& result_node) {
+        BOOST_ASSERT_MSG(leaf_id + 1 < m_number_of_leaf_offsets, "leaf id out of range");
+        if(NULL != m_leaf_data) {
+            const uint64_t leaf_begin = m_leaf_offset_array[leaf_id];
+            const uint64_t leaf_size = m_leaf_offset_array[leaf_id+1] - leaf_begin;
+            BOOST_ASSERT_MSG(leaf_size <= sizeof(CompressedLeafNode), "leaf too large");
+            std::memcpy((char *)&result_node, m_leaf_data + leaf_begin, leaf_size);
+            return;
+        }
+        if(
+            !thread_local_rtree_stream.get() ||
+            !thread_local_rtree_stream->stream.is_open() ||
+            m_rtree_id != thread_local_rtree_stream->rtree_id
+        ) {
+            thread_local_rtree_stream.reset(new RTreeLeafStream(m_rtree_id));
+            thread_local_rtree_stream->stream.open(
+                m_leaf_node_filename,
+                std::ios::in | std::ios::binary
             );
         }
-        if(!thread_local_rtree_stream->good()) {
-            thread_local_rtree_stream->clear(std::ios::goodbit);
+        boost::filesystem::ifstream & leaf_stream = thread_local_rtree_stream->stream;
+        if(!leaf_stream.good()) {
+            leaf_stream.clear(std::ios::goodbit);
             SimpleLogger().Write(logDEBUG) << "Resetting stale filestream";
         }
-        uint64_t seek_pos = sizeof(uint64_t) + leaf_id*sizeof(LeafNode);
-        thread_local_rtree_stream->seekg(seek_pos);
-        thread_local_rtree_stream->read((char *)&result_node, sizeof(LeafNode));
+        const uint64_t seek_pos = m_leaf_offset_array[leaf_id];
+        const uint64_t leaf_size = m_leaf_offset_array[leaf_id+1] - seek_pos;
+        BOOST_ASSERT_MSG(leaf_size <= sizeof(CompressedLeafNode), "leaf too large");
+        leaf_stream.seekg(seek_pos);
+        leaf_stream.read((char *)&result_node, leaf_size);
     }
 
     inline double ComputePerpendicularDistance(
@@ -355,7 +355,7 @@ public:
 
 
                     reply.content += "\",\"";
-                    reply.content += sEngine.GetEscapedNameForNameID(segment.nameID);
+                    sEngine.AppendEscapedNameForNameID(segment.nameID, reply.content);
                     reply.content += "\",";
                     intToString(segment.length, tmpDist);
                     reply.content += tmpDist;
@@ -273,18 +273,9 @@ void ExtractionContainers::PrepareData(const std::string & output_file_name, con
         std::cout << "ok" << std::endl;
         time = get_timestamp();
         std::cout << "[extractor] writing street name index ... " << std::flush;
+        //names are unique already, the callbacks map equal names to one id
         std::string nameOutFileName = (output_file_name + ".names");
-        std::ofstream nameOutFile(nameOutFileName.c_str(), std::ios::binary);
-        unsigned sizeOfNameIndex = nameVector.size();
-        nameOutFile.write((char *)&(sizeOfNameIndex), sizeof(unsigned));
-
-        BOOST_FOREACH(const std::string & str, nameVector) {
-            unsigned lengthOfRawString = strlen(str.c_str());
-            nameOutFile.write((char *)&(lengthOfRawString), sizeof(unsigned));
-            nameOutFile.write(str.c_str(), lengthOfRawString);
-        }
-
-        nameOutFile.close();
+        NameTable::Write(nameVector.begin(), nameVector.end(), nameOutFileName);
         std::cout << "ok, after " << get_timestamp() - time << "s" << std::endl;
 
         //        time = get_timestamp();
@@ -20,16 +20,181 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include "OSRM.h"
 
-OSRM::OSRM(const char * server_ini_path) {
-    if( !testDataFile(server_ini_path) ){
-        std::string error_message = std::string(server_ini_path) + " not found";
+OSRM::OSRM(const char * server_ini_path) :
+    serverIniPath(server_ini_path),
+    reclaimer(new DatasetReclaimer()),
+    currentDatasets(LoadDatasets())
+{
+    //replicas are loaded in the order of the nodes, cpus that are not
+    //listed use the first data set
+    const std::vector<NUMANode> nodes = GetNUMANodes();
+    for(unsigned i = 0; i < nodes.size(); ++i) {
+        const unsigned dataset_index = (nodes.size() == currentDatasets.size()) ? i : 0;
+        for(unsigned j = 0; j < nodes[i].cpus.size(); ++j) {
+            const unsigned cpu = nodes[i].cpus[j];
+            if( datasetOfCPU.size() <= cpu ) {
+                datasetOfCPU.resize(cpu+1, 0);
+            }
+            datasetOfCPU[cpu] = dataset_index;
+        }
+    }
+}
+
+OSRM::~OSRM() { }
+
+bool OSRM::Reload() {
+    boost::mutex::scoped_lock lock(reloadMutex);
+    try {
+        SimpleLogger().Write() << "reloading data set";
+        const std::vector<DatasetPtr> new_datasets = LoadDatasets();
+        if( new_datasets.size() != currentDatasets.size() ) {
+            throw OSRMException("NUMA replication changed, restart to apply it");
+        }
+        //queries that started before the swap keep the previous data set,
+        //the last one to finish hands it to the reclaimer
+        for(unsigned i = 0; i < currentDatasets.size(); ++i) {
+            boost::atomic_store(&currentDatasets[i], new_datasets[i]);
+        }
+    } catch(const std::exception & e) {
+        SimpleLogger().Write(logWARNING) <<
+            "reload failed, still serving the previous data set: " << e.what();
+        return false;
+    }
+    SimpleLogger().Write() << "new data set is live";
+    return true;
+}
+
+OSRM::DatasetReclaimer::~DatasetReclaimer() {
+    {
+        boost::mutex::scoped_lock lock(queueMutex);
+        stopped = true;
+    }
+    datasetAvailable.notify_one();
+    reclaimThread.join();
+}
+
+void OSRM::DatasetReclaimer::Reclaim(Dataset * dataset) {
+    {
+        boost::mutex::scoped_lock lock(queueMutex);
+        pendingDatasets.push_back(dataset);
+    }
+    datasetAvailable.notify_one();
+}
+
+void OSRM::DatasetReclaimer::Run() {
+    for(;;) {
+        Dataset * dataset = NULL;
+        {
+            boost::mutex::scoped_lock lock(queueMutex);
+            while( !stopped && pendingDatasets.empty() ) {
+                datasetAvailable.wait(lock);
+            }
+            if( pendingDatasets.empty() ) {
+                return;
+            }
+            dataset = pendingDatasets.front();
+            pendingDatasets.pop_front();
+        }
+        delete dataset;
+        SimpleLogger().Write() << "data set released";
+    }
+}
+
+std::vector<OSRM::DatasetPtr> OSRM::LoadDatasets() const {
+    if( !testDataFile(serverIniPath) ){
+        std::string error_message = serverIniPath + " not found";
         throw OSRMException(error_message.c_str());
     }
 
-    IniFile serverConfig(server_ini_path);
+    IniFile serverConfig(serverIniPath.c_str());
+
+    //by default memory is placed on the node that touches it first
+    std::string numa_policy = serverConfig.GetParameter("NUMAPolicy");
+    if( !numa_policy.empty() && "replicate" != numa_policy && "interleave" != numa_policy ) {
+        SimpleLogger().Write(logWARNING) << "unknown NUMAPolicy " << numa_policy;
+        numa_policy.clear();
+    }
+    const std::vector<NUMANode> nodes = GetNUMANodes();
+    if( !numa_policy.empty() && 1 == nodes.size() ) {
+        SimpleLogger().Write() << "single NUMA node, ignoring NUMAPolicy " << numa_policy;
+        numa_policy.clear();
+    }
+
+    std::vector<DatasetPtr> datasets;
+    if( "replicate" == numa_policy ) {
+        //each copy is allocated on the node it is loaded from
+        for(unsigned i = 0; i < nodes.size(); ++i) {
+            SimpleLogger().Write() << "loading data set for NUMA node " << nodes[i].id;
+            ScopedNUMANodeBinding node_binding(nodes[i]);
+            datasets.push_back(LoadDataset(serverConfig));
+        }
+    } else if( "interleave" == numa_policy ) {
+        ScopedInterleavedMemoryPolicy interleaved_policy(nodes);
+        datasets.push_back(LoadDataset(serverConfig));
+    } else {
+        datasets.push_back(LoadDataset(serverConfig));
+    }
 
+    if( serverConfig.Holds("HugePages") &&
+        0 != stringToInt(serverConfig.GetParameter("HugePages"))
+    ) {
+        for(unsigned i = 0; i < datasets.size(); ++i) {
+            datasets[i]->objects->AdviseHugePages();
+        }
+    }
+    return datasets;
+}
+
+OSRM::DatasetPtr OSRM::LoadDataset(IniFile & serverConfig) const {
     boost::filesystem::path base_path =
-               boost::filesystem::absolute(server_ini_path).parent_path();
+               boost::filesystem::absolute(serverIniPath).parent_path();
+
+    DatasetPtr dataset(new Dataset(), ReclaimDataset(reclaimer));
+
+    //the dataset may have been loaded into shared memory by osrm-datastore
+    const bool use_shared_memory =
+        serverConfig.Holds("SharedMemory") &&
+        0 != stringToInt(serverConfig.GetParameter("SharedMemory"));
+    if ( use_shared_memory ) {
+        dataset->objects = new QueryObjectsStorage(
+            new SharedDataRegion(),
+            GetPhantomNodeCacheSize(serverConfig),
+            GetPhantomNodeCacheResolution(serverConfig)
+        );
+        dataset->RegisterPlugins();
+        return dataset;
+    }
+
+    //a dataset container replaces all of the single data files below
+    if ( serverConfig.Holds("dataset") ) {
+        const bool read_into_memory =
+            serverConfig.Holds("readDatasetIntoMemory") &&
+            0 != stringToInt(serverConfig.GetParameter("readDatasetIntoMemory"));
+        DatasetContainer * container = new DatasetContainer(
+            boost::filesystem::absolute(
+                serverConfig.GetParameter("dataset"),
+                base_path
+            ).string(),
+            read_into_memory
+        );
+        try {
+            if( serverConfig.Holds("verifyDataset") &&
+                0 != stringToInt(serverConfig.GetParameter("verifyDataset"))
+            ) {
+                container->VerifySections();
+            }
+        } catch(...) {
+            delete container;
+            throw;
+        }
+        dataset->objects = new QueryObjectsStorage(
+            container,
+            GetPhantomNodeCacheSize(serverConfig),
+            GetPhantomNodeCacheResolution(serverConfig)
+        );
+        dataset->RegisterPlugins();
+        return dataset;
+    }
 
     if ( !serverConfig.Holds("hsgrData")) {
         throw OSRMException("no ram index file name in server ini");
@@ -79,42 +244,117 @@ OSRM::OSRM(const char * server_ini_path) {
             base_path
     );
 
-    objects = new QueryObjectsStorage(
+    //the grid index is an optional accelerator in front of the r-tree
+    std::string grid_index_path;
+    if ( serverConfig.Holds("gridIndex") ) {
+        grid_index_path = boost::filesystem::absolute(
+            serverConfig.GetParameter("gridIndex"),
+            base_path
+        ).string();
+    }
+
+    //checks the files against the checksums osrm-prepare listed for them
+    if( serverConfig.Holds("verifyDataFiles") &&
+        0 != stringToInt(serverConfig.GetParameter("verifyDataFiles"))
+    ) {
+        if ( !serverConfig.Holds("checksums") ) {
+            throw OSRMException("no checksums file name in server ini");
+        }
+        std::vector<std::string> data_files;
+        data_files.push_back(hsgr_path.string());
+        data_files.push_back(ram_index_path.string());
+        data_files.push_back(file_index_path.string());
+        data_files.push_back(node_data_path.string());
+        data_files.push_back(edge_data_path.string());
+        data_files.push_back(name_data_path.string());
+        if( boost::filesystem::exists(timestamp_path) ) {
+            data_files.push_back(timestamp_path.string());
+        }
+        if( !grid_index_path.empty() ) {
+            data_files.push_back(grid_index_path);
+        }
+        VerifyDataFiles(
+            boost::filesystem::absolute(
+                serverConfig.GetParameter("checksums"),
+                base_path
+            ).string(),
+            data_files
+        );
+    }
+
+    dataset->objects = new QueryObjectsStorage(
         hsgr_path.string(),
         ram_index_path.string(),
         file_index_path.string(),
         node_data_path.string(),
         edge_data_path.string(),
         name_data_path.string(),
-        timestamp_path.string()
+        timestamp_path.string(),
+        grid_index_path,
+        GetPhantomNodeCacheSize(serverConfig),
+        GetPhantomNodeCacheResolution(serverConfig),
+        serverConfig.Holds("compressEdgeRecords") &&
+        0 != stringToInt(serverConfig.GetParameter("compressEdgeRecords"))
     );
+    dataset->RegisterPlugins();
+    return dataset;
+}
+
+//snapped coordinates are cached unless the cache size is set to 0
+unsigned OSRM::GetPhantomNodeCacheSize(IniFile & serverConfig) {
+    if ( serverConfig.Holds("phantomNodeCacheSize") ) {
+        return std::max(
+            0,
+            stringToInt(serverConfig.GetParameter("phantomNodeCacheSize"))
+        );
+    }
+    return 65536;
+}
 
-    RegisterPlugin(new HelloWorldPlugin());
+unsigned OSRM::GetPhantomNodeCacheResolution(IniFile & serverConfig) {
+    if ( serverConfig.Holds("phantomNodeCacheResolution") ) {
+        return std::max(
+            0,
+            stringToInt(serverConfig.GetParameter("phantomNodeCacheResolution"))
+        );
+    }
+    return 1;
+}
+
+void OSRM::Dataset::RegisterPlugins() {
+    RegisterPlugin(new HelloWorldPlugin(objects));
     RegisterPlugin(new LocatePlugin(objects));
     RegisterPlugin(new NearestPlugin(objects));
     RegisterPlugin(new TimestampPlugin(objects));
     RegisterPlugin(new ViaRoutePlugin(objects));
     RegisterPlugin(new DistanceMatrixPlugin(objects));
+    RegisterPlugin(new MetricsPlugin());
 }
 
-OSRM::~OSRM() {
+OSRM::Dataset::~Dataset() {
     BOOST_FOREACH(PluginMap::value_type & plugin_pointer, pluginMap) {
         delete plugin_pointer.second;
     }
     delete objects;
 }
 
-void OSRM::RegisterPlugin(BasePlugin * plugin) {
+void OSRM::Dataset::RegisterPlugin(BasePlugin * plugin) {
     SimpleLogger().Write()  << "loaded plugin: " << plugin->GetDescriptor();
     if( pluginMap.find(plugin->GetDescriptor()) != pluginMap.end() ) {
         delete pluginMap[plugin->GetDescriptor()];
     }
     pluginMap.insert(std::make_pair(plugin->GetDescriptor(), plugin));
+    QueryMetrics::GetInstance().RegisterService(plugin->GetDescriptor());
 }
 
 void OSRM::RunQuery(RouteParameters & route_parameters, http::Reply & reply) {
-    const PluginMap::const_iterator & iter = pluginMap.find(route_parameters.service);
-    if(pluginMap.end() != iter) {
+    //keeps the data set alive even if it is replaced meanwhile
+    const unsigned cpu = GetCurrentCPU();
+    const DatasetPtr dataset = boost::atomic_load(
+        &currentDatasets[cpu < datasetOfCPU.size() ? datasetOfCPU[cpu] : 0]
+    );
+    const PluginMap::const_iterator & iter = dataset->pluginMap.find(route_parameters.service);
+    if(dataset->pluginMap.end() != iter) {
         reply.status = http::Reply::ok;
         iter->second->HandleRequest(route_parameters, reply );
     } else {
@@ -26,34 +26,105 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #include "../Plugins/BasePlugin.h"
 #include "../Plugins/HelloWorldPlugin.h"
 #include "../Plugins/LocatePlugin.h"
+#include "../Plugins/MetricsPlugin.h"
 #include "../Plugins/NearestPlugin.h"
 #include "../Plugins/TimestampPlugin.h"
 #include "../Plugins/ViaRoutePlugin.h"
 #include "../Plugins/DistanceMatrix.h"
 #include "../Server/DataStructures/RouteParameters.h"
+#include "../Util/DataFileChecksums.h"
 #include "../Util/IniFile.h"
 #include "../Util/InputFileUtil.h"
+#include "../Util/MemoryPlacement.h"
 #include "../Util/OSRMException.h"
+#include "../Util/QueryMetrics.h"
 #include "../Util/SimpleLogger.h"
 #include "../Server/BasicDatastructures.h"
 
 #include <boost/assert.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <deque>
+#include <string>
 #include <vector>
 
 class OSRM : boost::noncopyable {
     typedef boost::unordered_map<std::string, BasePlugin *> PluginMap;
-    QueryObjectsStorage * objects;
+
+    //query objects and the plugins working on them, replaced as a whole
+    struct Dataset : boost::noncopyable {
+        Dataset() : objects(NULL) { }
+        ~Dataset();
+        void RegisterPlugins();
+        void RegisterPlugin(BasePlugin * plugin);
+
+        QueryObjectsStorage * objects;
+        PluginMap pluginMap;
+    };
+    typedef boost::shared_ptr<Dataset> DatasetPtr;
+
+    //Frees data sets on its own thread, so that neither the query that held
+    //the last reference to a replaced data set nor a reload waits for it.
+    class DatasetReclaimer : boost::noncopyable {
+    public:
+        DatasetReclaimer() :
+            stopped(false),
+            reclaimThread(boost::bind(&DatasetReclaimer::Run, this))
+        { }
+        //data sets that were handed over are freed before it returns
+        ~DatasetReclaimer();
+        void Reclaim(Dataset * dataset);
+    private:
+        void Run();
+
+        bool stopped;
+        boost::mutex queueMutex;
+        boost::condition_variable datasetAvailable;
+        std::deque<Dataset *> pendingDatasets;
+        boost::thread reclaimThread;
+    };
+
+    //deleter of DatasetPtr, keeps the reclaimer alive as long as a data set
+    struct ReclaimDataset {
+        ReclaimDataset(const boost::shared_ptr<DatasetReclaimer> & r) : reclaimer(r) { }
+        void operator()(Dataset * dataset) const {
+            reclaimer->Reclaim(dataset);
+        }
+        boost::shared_ptr<DatasetReclaimer> reclaimer;
+    };
+
 public:
     OSRM(const char * server_ini_path);
     ~OSRM();
     void RunQuery(RouteParameters & route_parameters, http::Reply & reply);
+
+    //Loads the data set anew while queries are answered from the current
+    //one. Returns false and keeps the current data set if loading fails.
+    //The previous data set is freed in the background once the queries
+    //that still use it completed.
+    bool Reload();
+
 private:
-    void RegisterPlugin(BasePlugin * plugin);
-    PluginMap pluginMap;
+    //one data set, or one per NUMA node if they are replicated
+    std::vector<DatasetPtr> LoadDatasets() const;
+    DatasetPtr LoadDataset(IniFile & serverConfig) const;
+    static unsigned GetPhantomNodeCacheSize(IniFile & serverConfig);
+    static unsigned GetPhantomNodeCacheResolution(IniFile & serverConfig);
+
+    const std::string serverIniPath;
+    boost::mutex reloadMutex;
+    //declared before the data sets, which it outlives
+    const boost::shared_ptr<DatasetReclaimer> reclaimer;
+    //read and replaced with boost::atomic_load/atomic_store, each query
+    //holds a reference until it completed. The number of data sets does not
+    //change after construction.
+    std::vector<DatasetPtr> currentDatasets;
+    //index of the data set that queries running on a cpu use
+    std::vector<unsigned> datasetOfCPU;
 };
 
 #endif //OSRM_H
@@ -47,7 +47,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 class DistanceMatrixPlugin : public BasePlugin {
 private:
     NodeInformationHelpDesk * nodeHelpDesk;
-    std::vector<std::string> & names;
+    const NameTable & names;
     StaticGraph<QueryEdge::EdgeData> * graph;
     HashTable<std::string, unsigned> descriptorTable;
     SearchEngine* searchEngine;
@@ -100,7 +100,7 @@ public:
                 }
             }
 //            INFO("Brute force lookup of coordinate " << i);
-            searchEngine->FindPhantomNodeForCoordinate( rawRoute.rawViaNodeCoordinates[i], phantomNodeVector[i], routeParameters.zoomLevel);
+            searchEngine->FindPhantomNodeForCoordinate( rawRoute.rawViaNodeCoordinates[i], phantomNodeVector[i], routeParameters.zoomLevel, routeParameters.getBearingFilter(i));
         }
 
         reply.status = http::Reply::ok;
@@ -160,7 +160,9 @@ public:
                 }
                 desc->SetConfig(descriptorConfig);
                 http::Reply partReply;
+                ScopedPhaseTimer describe_timer(phaseDescribe);
                 desc->Run(partReply, rawRouteLocal, phantomNodes, *searchEngine);
+                describe_timer.Stop();
                 arr += sep;
                 arr += partReply.content;
                 sep = ",";
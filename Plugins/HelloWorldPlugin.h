@@ -22,12 +22,16 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #define HELLOWORLDPLUGIN_H_
 
 #include "BasePlugin.h"
+#include "../DataStructures/NodeInformationHelpDesk.h"
+#include "../Server/DataStructures/QueryObjectsStorage.h"
 
 #include <sstream>
 
 class HelloWorldPlugin : public BasePlugin {
 public:
-	HelloWorldPlugin() : descriptor_string("hello"){}
+	HelloWorldPlugin(QueryObjectsStorage * objects) : descriptor_string("hello") {
+		nodeHelpDesk = objects->nodeHelpDesk;
+	}
 	virtual ~HelloWorldPlugin() { }
 	const std::string & GetDescriptor()    const { return descriptor_string; }
 
@@ -52,11 +56,20 @@ public:
         for(unsigned i = 0; i < routeParameters.hints.size(); ++i) {
             content << "  [" << i << "] " << routeParameters.hints[i] << "\n";
         }
+        const PhantomNodeCache * phantom_node_cache = nodeHelpDesk->GetPhantomNodeCache();
+        if( NULL != phantom_node_cache ) {
+            content << "phantom node cache: " << phantom_node_cache->GetNumberOfEntries() << " entries, ";
+            content << phantom_node_cache->GetNumberOfHits() << " hits, ";
+            content << phantom_node_cache->GetNumberOfMisses() << " misses\n";
+        } else {
+            content << "phantom node cache: disabled\n";
+        }
         content << "</pre>";
 		reply.content.append(content.str());
 		reply.content.append("</body></html>");
 	}
 private:
+    NodeInformationHelpDesk * nodeHelpDesk;
     std::string descriptor_string;
 };
 
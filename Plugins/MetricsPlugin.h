@@ -0,0 +1,57 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef METRICSPLUGIN_H_
+#define METRICSPLUGIN_H_
+
+#include "BasePlugin.h"
+#include "../Util/QueryMetrics.h"
+#include "../Util/StringUtil.h"
+
+#include <string>
+
+/*
+ * Exports the latency histograms and search space statistics of the server
+ * in the text format that Prometheus scrapes.
+ */
+class MetricsPlugin : public BasePlugin {
+public:
+    MetricsPlugin() : descriptor_string("metrics") { }
+    virtual ~MetricsPlugin() { }
+    const std::string & GetDescriptor() const { return descriptor_string; }
+
+    void HandleRequest(const RouteParameters &, http::Reply& reply) {
+        reply.status = http::Reply::ok;
+        QueryMetrics::GetInstance().Export(reply.content);
+
+        reply.headers.resize(2);
+        reply.headers[0].name = "Content-Length";
+        std::string tmp;
+        intToString(reply.content.size(), tmp);
+        reply.headers[0].value = tmp;
+        reply.headers[1].name = "Content-Type";
+        reply.headers[1].value = "text/plain; version=0.0.4";
+    }
+
+private:
+    std::string descriptor_string;
+};
+
+#endif /* METRICSPLUGIN_H_ */
@@ -56,7 +56,7 @@ public:
 
         //query to helpdesk
         PhantomNode result;
-        nodeHelpDesk->FindPhantomNodeForCoordinate(routeParameters.coordinates[0], result, routeParameters.zoomLevel);
+        nodeHelpDesk->FindPhantomNodeForCoordinate(routeParameters.coordinates[0], result, routeParameters.zoomLevel, routeParameters.getBearingFilter(0));
 
         std::string tmp;
         //json
@@ -86,7 +86,7 @@ public:
         reply.content += "],";
         reply.content += "\"name\":\"";
         if(UINT_MAX != result.edgeBasedNode)
-            reply.content += names[result.nodeBasedEdgeNameID];
+            names.AppendEscapedName(result.nodeBasedEdgeNameID, reply.content);
         reply.content += "\"";
         reply.content += ",\"transactionId\":\"OSRM Routing Engine JSON Nearest (v0.3)\"";
         reply.content += ("}");
@@ -111,7 +111,7 @@ public:
 private:
     NodeInformationHelpDesk * nodeHelpDesk;
     HashTable<std::string, unsigned> descriptorTable;
-    std::vector<std::string> & names;
+    const NameTable & names;
     std::string descriptor_string;
 };
 
@@ -43,7 +43,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 class ViaRoutePlugin : public BasePlugin {
 private:
     NodeInformationHelpDesk * nodeHelpDesk;
-    std::vector<std::string> & names;
+    const NameTable & names;
     StaticGraph<QueryEdge::EdgeData> * graph;
     HashTable<std::string, unsigned> descriptorTable;
     SearchEngine * searchEnginePtr;
@@ -99,7 +99,7 @@ public:
                 }
             }
 //            SimpleLogger().Write() << "Brute force lookup of coordinate " << i;
-            searchEnginePtr->FindPhantomNodeForCoordinate( rawRoute.rawViaNodeCoordinates[i], phantomNodeVector[i], routeParameters.zoomLevel);
+            searchEnginePtr->FindPhantomNodeForCoordinate( rawRoute.rawViaNodeCoordinates[i], phantomNodeVector[i], routeParameters.zoomLevel, routeParameters.getBearingFilter(i));
         }
 
         for(unsigned i = 0; i < phantomNodeVector.size()-1; ++i) {
@@ -159,7 +159,9 @@ public:
 //        SimpleLogger().Write() << "Number of segments: " << rawRoute.segmentEndCoordinates.size();
         desc->SetConfig(descriptorConfig);
 
+        ScopedPhaseTimer describe_timer(phaseDescribe);
         desc->Run(reply, rawRoute, phantomNodes, *searchEnginePtr);
+        describe_timer.Stop();
         if("" != routeParameters.jsonpParameter) {
             reply.content += ")\n";
         }
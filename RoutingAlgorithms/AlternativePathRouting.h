@@ -61,6 +61,7 @@ public:
             return;
         }
 
+        ScopedPhaseTimer search_timer(phaseSearch);
         std::vector<NodeID> alternativePath;
         std::vector<NodeID> viaNodeCandidates;
         std::vector<SearchSpaceEdge> forward_search_space;
@@ -100,6 +101,11 @@ public:
             }
         }
         sort_unique_resize(viaNodeCandidates);
+        uint64_t settled_nodes = 0;
+        uint64_t heap_size = 0;
+        super::AddSearchSpace(forward_heap1, settled_nodes, heap_size);
+        super::AddSearchSpace(reverse_heap1, settled_nodes, heap_size);
+        QueryMetrics::GetInstance().RecordSearch(settled_nodes, heap_size);
 
         std::vector<NodeID> packed_forward_path;
         std::vector<NodeID> packed_reverse_path;
@@ -179,6 +185,8 @@ public:
         }
 
         //Unpack shortest path and alternative, if they exist
+        search_timer.Stop();
+        ScopedPhaseTimer unpack_timer(phaseUnpack);
         if(INT_MAX != upper_bound_to_shortest_path_distance) {
             super::UnpackPath(packedShortestPath, rawRouteData.computedShortestPath);
             rawRouteData.lengthOfShortestPath = upper_bound_to_shortest_path_distance;
@@ -25,6 +25,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include "../DataStructures/RawRouteData.h"
 #include "../Util/ContainerUtils.h"
+#include "../Util/QueryMetrics.h"
 #include "../Util/SimpleLogger.h"
 
 #include <boost/noncopyable.hpp>
@@ -42,6 +43,12 @@ public:
     BasicRoutingInterface(QueryDataT & qd) : _queryData(qd) { }
     virtual ~BasicRoutingInterface(){ };
 
+    //adds up the search space of the heaps of one search
+    static inline void AddSearchSpace(const typename QueryDataT::QueryHeap & heap, uint64_t & settled_nodes, uint64_t & heap_size) {
+        settled_nodes += heap.NumberOfSettledNodes();
+        heap_size += heap.NumberOfInsertedNodes();
+    }
+
     inline void RoutingStep(typename QueryDataT::QueryHeap & _forwardHeap, typename QueryDataT::QueryHeap & _backwardHeap, NodeID *middle, int *_upperbound, const int edgeBasedOffset, const bool forwardDirection) const {
         const NodeID node = _forwardHeap.DeleteMin();
         const int distance = _forwardHeap.GetKey(node);
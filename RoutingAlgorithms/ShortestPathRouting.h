@@ -41,6 +41,7 @@ public:
                 return;
             }
         }
+        ScopedPhaseTimer search_timer(phaseSearch);
         int distance1 = 0;
         int distance2 = 0;
 
@@ -113,6 +114,13 @@ public:
                     }
                 }
             }
+            uint64_t settled_nodes = 0;
+            uint64_t heap_size = 0;
+            super::AddSearchSpace(forward_heap1, settled_nodes, heap_size);
+            super::AddSearchSpace(reverse_heap1, settled_nodes, heap_size);
+            super::AddSearchSpace(forward_heap2, settled_nodes, heap_size);
+            super::AddSearchSpace(reverse_heap2, settled_nodes, heap_size);
+            QueryMetrics::GetInstance().RecordSearch(settled_nodes, heap_size);
 
             //No path found for both target nodes?
             if((INT_MAX == _localUpperbound1) && (INT_MAX == _localUpperbound2)) {
@@ -191,6 +199,8 @@ public:
         if(distance1 > distance2){
             std::swap(packedPath1, packedPath2);
         }
+        search_timer.Stop();
+        ScopedPhaseTimer unpack_timer(phaseUnpack);
         remove_consecutive_duplicates_from_vector(packedPath1);
         super::UnpackPath(packedPath1, rawRouteData.computedShortestPath);
         rawRouteData.lengthOfShortestPath = std::min(distance1, distance2);
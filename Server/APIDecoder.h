@@ -0,0 +1,241 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef APIDECODER_H_
+#define APIDECODER_H_
+
+#include "DataStructures/RouteParameters.h"
+
+#include <boost/fusion/container/vector.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/spirit/include/qi.hpp>
+
+#include <cstring>
+#include <string>
+
+// Hand-written equivalent of APIGrammar. It accepts exactly the same input,
+// reports errors at the same position and calls the same setters, but it
+// neither builds rules nor allocates per request. Numbers are still read by
+// Spirit's primitives, so that they convert bit for bit like the grammar.
+// String values are staged in a buffer that is reused across requests.
+
+class APIDecoder : boost::noncopyable {
+public:
+    //Reads "/service", or "/profile/service", and any number of "?parameters".
+    //it is left behind the last complete parameter. Fails without moving it
+    //if there is no service.
+    bool DecodeURI(const char * & it, const char * end, RouteParameters & parameters) {
+        const char * position = it;
+        if( position == end || '/' != *position ) {
+            return false;
+        }
+        ++position;
+        const char * service_end = SkipLetters(position, end);
+        if( service_end != position && service_end != end && '/' == *service_end ) {
+            token.assign(position, service_end);
+            parameters.setProfile(token);
+            position = service_end + 1;
+            service_end = SkipLetters(position, end);
+        }
+        if( service_end == position ) {
+            return false;
+        }
+        token.assign(position, service_end);
+        parameters.setService(token);
+        position = service_end;
+
+        while( position != end && '?' == *position ) {
+            const char * query_end = position + 1;
+            if( !DecodeParameters(query_end, end, parameters) ) {
+                break;
+            }
+            position = query_end;
+        }
+        it = position;
+        return true;
+    }
+
+    //Reads one or more parameters, i.e. "key=value" optionally led by '&'
+    bool DecodeParameters(const char * & it, const char * end, RouteParameters & parameters) {
+        bool found_parameter = false;
+        while( DecodeParameter(it, end, parameters) ) {
+            found_parameter = true;
+        }
+        return found_parameter;
+    }
+
+private:
+    bool DecodeParameter(const char * & it, const char * end, RouteParameters & parameters) {
+        namespace qi = boost::spirit::qi;
+        const char * position = it;
+        if( position != end && '&' == *position ) {
+            ++position;
+        }
+        //no key is a prefix of another one, the longest run of letters decides
+        const char * key = position;
+        position = SkipLetters(position, end);
+        const std::size_t key_length = position - key;
+        if( position == end || '=' != *position ) {
+            return false;
+        }
+        ++position;
+
+        if( IsKey(key, key_length, "z") ) {
+            short zoom_level;
+            if( !qi::parse(position, end, qi::short_, zoom_level) ) {
+                return false;
+            }
+            parameters.setZoomLevel(zoom_level);
+        } else if( IsKey(key, key_length, "output") ) {
+            if( !ReadToken(position, end, SkipLetters) ) {
+                return false;
+            }
+            parameters.setOutputFormat(token);
+        } else if( IsKey(key, key_length, "jsonp") ) {
+            if( !ReadToken(position, end, SkipTokenCharacters) ) {
+                return false;
+            }
+            parameters.setJSONpParameter(token);
+        } else if( IsKey(key, key_length, "checksum") ) {
+            int check_sum;
+            if( !qi::parse(position, end, qi::int_, check_sum) ) {
+                return false;
+            }
+            parameters.setChecksum(check_sum);
+        } else if( IsKey(key, key_length, "loc") ) {
+            double lat, lon;
+            if(
+                !qi::parse(position, end, qi::double_, lat) ||
+                position == end || ',' != *position++ ||
+                !qi::parse(position, end, qi::double_, lon)
+            ) {
+                return false;
+            }
+            parameters.addCoordinate(boost::fusion::vector<double, double>(lat, lon));
+        } else if( IsKey(key, key_length, "hint") ) {
+            if( !ReadToken(position, end, SkipTokenCharacters) ) {
+                return false;
+            }
+            parameters.addHint(token);
+        } else if( IsKey(key, key_length, "b") ) {
+            int bearing, range;
+            if(
+                !qi::parse(position, end, qi::int_, bearing) ||
+                position == end || ',' != *position++ ||
+                !qi::parse(position, end, qi::int_, range)
+            ) {
+                return false;
+            }
+            parameters.addBearing(boost::fusion::vector<int, int>(bearing, range));
+        } else if( IsKey(key, key_length, "compression") ) {
+            bool flag;
+            if( !qi::parse(position, end, qi::bool_, flag) ) {
+                return false;
+            }
+            parameters.setCompressionFlag(flag);
+        } else if( IsKey(key, key_length, "hl") ) {
+            if( !ReadToken(position, end, SkipLetters) ) {
+                return false;
+            }
+            parameters.setLanguage(token);
+        } else if( IsKey(key, key_length, "instructions") ) {
+            bool flag;
+            if( !qi::parse(position, end, qi::bool_, flag) ) {
+                return false;
+            }
+            parameters.setInstructionFlag(flag);
+        } else if( IsKey(key, key_length, "geometry") ) {
+            bool flag;
+            if( !qi::parse(position, end, qi::bool_, flag) ) {
+                return false;
+            }
+            parameters.setGeometryFlag(flag);
+        } else if( IsKey(key, key_length, "alt") ) {
+            bool flag;
+            if( !qi::parse(position, end, qi::bool_, flag) ) {
+                return false;
+            }
+            parameters.setAlternateRouteFlag(flag);
+        } else if( IsKey(key, key_length, "geomformat") ) {
+            if( !ReadToken(position, end, SkipLetters) ) {
+                return false;
+            }
+            parameters.setDeprecatedAPIFlag(token);
+        } else if( IsKey(key, key_length, "profile") ) {
+            if( !ReadToken(position, end, SkipLetters) ) {
+                return false;
+            }
+            parameters.setProfile(token);
+        } else {
+            return false;
+        }
+        it = position;
+        return true;
+    }
+
+    //stages a non-empty value in the reusable token buffer
+    bool ReadToken(
+        const char * & position,
+        const char * end,
+        const char * (*skip)(const char *, const char *)
+    ) {
+        const char * token_end = skip(position, end);
+        if( token_end == position ) {
+            return false;
+        }
+        token.assign(position, token_end);
+        position = token_end;
+        return true;
+    }
+
+    static inline bool IsKey(const char * key, const std::size_t length, const char * name) {
+        return ( length == std::strlen(name) ) && ( 0 == std::memcmp(key, name, length) );
+    }
+
+    static inline bool IsLetter(const char c) {
+        return ( 'a' <= c && c <= 'z' ) || ( 'A' <= c && c <= 'Z' );
+    }
+
+    //[a-zA-Z]
+    static const char * SkipLetters(const char * position, const char * end) {
+        while( position != end && IsLetter(*position) ) {
+            ++position;
+        }
+        return position;
+    }
+
+    //[a-zA-Z0-9_.-]
+    static const char * SkipTokenCharacters(const char * position, const char * end) {
+        while(
+            position != end && (
+                IsLetter(*position) ||
+                ( '0' <= *position && *position <= '9' ) ||
+                '_' == *position || '.' == *position || '-' == *position
+            )
+        ) {
+            ++position;
+        }
+        return position;
+    }
+
+    std::string token;
+};
+
+#endif /* APIDECODER_H_ */
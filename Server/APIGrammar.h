@@ -32,8 +32,9 @@ namespace qi = boost::spirit::qi;
 template <typename Iterator, class HandlerT>
 struct APIGrammar : qi::grammar<Iterator> {
     APIGrammar(HandlerT * h) : APIGrammar::base_type(api_call), handler(h) {
-        api_call = qi::lit('/') >> string[boost::bind(&HandlerT::setService, handler, ::_1)] >> *(query);
-        query    = ('?') >> (+(zoom | output | jsonp | checksum | location | hint | cmp | language | instruction | geometry | alt_route | old_API) ) ;
+        api_call = qi::lit('/') >> -((string >> '/')[boost::bind(&HandlerT::setProfile, handler, ::_1)]) >> string[boost::bind(&HandlerT::setService, handler, ::_1)] >> *(query);
+        query    = ('?') >> parameters;
+        parameters = +(zoom | output | jsonp | checksum | location | hint | bearing | cmp | language | instruction | geometry | alt_route | old_API | profile);
 
         zoom        = (-qi::lit('&')) >> qi::lit('z')            >> '=' >> qi::short_[boost::bind(&HandlerT::setZoomLevel, handler, ::_1)];
         output      = (-qi::lit('&')) >> qi::lit("output")       >> '=' >> string[boost::bind(&HandlerT::setOutputFormat, handler, ::_1)];
@@ -44,17 +45,19 @@ struct APIGrammar : qi::grammar<Iterator> {
         cmp         = (-qi::lit('&')) >> qi::lit("compression")  >> '=' >> qi::bool_[boost::bind(&HandlerT::setCompressionFlag, handler, ::_1)];
         location    = (-qi::lit('&')) >> qi::lit("loc")          >> '=' >> (qi::double_ >> qi::lit(',') >> qi::double_)[boost::bind(&HandlerT::addCoordinate, handler, ::_1)];
         hint        = (-qi::lit('&')) >> qi::lit("hint")         >> '=' >> stringwithDot[boost::bind(&HandlerT::addHint, handler, ::_1)];
+        bearing     = (-qi::lit('&')) >> qi::lit("b")            >> '=' >> (qi::int_ >> qi::lit(',') >> qi::int_)[boost::bind(&HandlerT::addBearing, handler, ::_1)];
         language    = (-qi::lit('&')) >> qi::lit("hl")           >> '=' >> string[boost::bind(&HandlerT::setLanguage, handler, ::_1)];
         alt_route   = (-qi::lit('&')) >> qi::lit("alt")          >> '=' >> qi::bool_[boost::bind(&HandlerT::setAlternateRouteFlag, handler, ::_1)];
         old_API     = (-qi::lit('&')) >> qi::lit("geomformat")   >> '=' >> string[boost::bind(&HandlerT::setDeprecatedAPIFlag, handler, ::_1)];
+        profile     = (-qi::lit('&')) >> qi::lit("profile")      >> '=' >> string[boost::bind(&HandlerT::setProfile, handler, ::_1)];
 
         string        = +(qi::char_("a-zA-Z"));
         stringwithDot = +(qi::char_("a-zA-Z0-9_.-"));
     }
-    qi::rule<Iterator> api_call, query;
+    qi::rule<Iterator> api_call, query, parameters;
     qi::rule<Iterator, std::string()> service, zoom, output, string, jsonp, checksum, location, hint,
-                                      stringwithDot, language, instruction, geometry,
-                                      cmp, alt_route, old_API;
+                                      bearing, stringwithDot, language, instruction, geometry,
+                                      cmp, alt_route, old_API, profile;
 
     HandlerT * handler;
 };
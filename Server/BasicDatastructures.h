@@ -25,6 +25,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include <boost/asio.hpp>
 #include <boost/foreach.hpp>
+#include <boost/range/iterator_range.hpp>
 
 #include <string>
 #include <sstream>
@@ -32,13 +33,21 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 namespace http {
 
-const std::string okString 					= "HTTP/1.0 200 OK\r\n";
-const std::string badRequestString 			= "HTTP/1.0 400 Bad Request\r\n";
-const std::string internalServerErrorString = "HTTP/1.0 500 Internal Server Error\r\n";
+const std::string okString 					= "HTTP/1.1 200 OK\r\n";
+const std::string badRequestString 			= "HTTP/1.1 400 Bad Request\r\n";
+const std::string lengthRequiredString      = "HTTP/1.1 411 Length Required\r\n";
+const std::string internalServerErrorString = "HTTP/1.1 500 Internal Server Error\r\n";
+const std::string notImplementedString      = "HTTP/1.1 501 Not Implemented\r\n";
+const std::string serviceUnavailableString  = "HTTP/1.1 503 Service Unavailable\r\n";
+//interim response to "Expect: 100-continue", the client sends the body then
+const std::string continueString            = "HTTP/1.1 100 Continue\r\n\r\n";
 
 const char okHTML[] 				 = "";
 const char badRequestHTML[] 		 = "<html><head><title>Bad Request</title></head><body><h1>400 Bad Request</h1></body></html>";
+const char lengthRequiredHTML[]      = "<html><head><title>Length Required</title></head><body><h1>411 Length Required</h1></body></html>";
 const char internalServerErrorHTML[] = "<html><head><title>Internal Server Error</title></head><body><h1>500 Internal Server Error</h1></body></html>";
+const char notImplementedHTML[]      = "<html><head><title>Not Implemented</title></head><body><h1>501 Not Implemented</h1></body></html>";
+const char serviceUnavailableHTML[]  = "<html><head><title>Service Unavailable</title></head><body><h1>503 Service Unavailable</h1></body></html>";
 const char seperators[]  			 = { ':', ' ' };
 const char crlf[]		             = { '\r', '\n' };
 
@@ -57,33 +66,66 @@ enum CompressionType {
     deflateRFC1951
 } Compression;
 
+/// uri and body point into the receive buffer of the connection and are
+/// valid until the reply has been sent
 struct Request {
-	std::string uri;
+	Request() : keepAlive(false), acceptsChunked(false), post(false), binaryBody(false) { }
+	boost::iterator_range<const char *> uri;
+	boost::iterator_range<const char *> body;
 	std::string referrer;
 	std::string agent;
 	boost::asio::ip::address endpoint;
+	bool keepAlive;
+	bool acceptsChunked;
+	bool post;
+	bool binaryBody;
 };
 
 struct Reply {
-    Reply() : status(ok) { content.reserve(2 << 20); }
+    Reply() : status(ok), compressionLevel(-1), serviceID(0) { }
 	enum status_type {
 		ok 					= 200,
 		badRequest 		    = 400,
-		internalServerError = 500
+		lengthRequired      = 411,
+		internalServerError = 500,
+		notImplemented      = 501,
+		serviceUnavailable  = 503
 	} status;
 
+	//zlib level of the service, negative for the default of the encoding
+	int compressionLevel;
+	//metrics slot of the service that answers
+	unsigned serviceID;
 	std::vector<Header> headers;
     std::vector<boost::asio::const_buffer> toBuffers();
     std::vector<boost::asio::const_buffer> HeaderstoBuffers();
 	std::string content;
 	static Reply stockReply(status_type status);
 	void setSize(const unsigned size) {
+		std::string sizeString;
+		intToString(size, sizeString);
+		setHeader("Content-Length", sizeString);
+	}
+	//replaces the value of an existing header or appends a new one
+	void setHeader(const std::string & name, const std::string & value) {
 		BOOST_FOREACH ( Header& h,  headers) {
-			if("Content-Length" == h.name) {
-				std::string sizeString;
-				intToString(size,h.value);
+			if(name == h.name) {
+				h.value = value;
+				return;
 			}
 		}
+		Header header;
+		header.name = name;
+		header.value = value;
+		headers.push_back(header);
+	}
+	//readies the reply for the next request, keeps the allocated content
+	void Reset() {
+		status = ok;
+		compressionLevel = -1;
+		serviceID = 0;
+		headers.clear();
+		content.clear();
 	}
 };
 
@@ -91,8 +133,14 @@ boost::asio::const_buffer ToBuffer(Reply::status_type status) {
 	switch (status) {
 	case Reply::ok:
 		return boost::asio::buffer(okString);
+	case Reply::lengthRequired:
+		return boost::asio::buffer(lengthRequiredString);
 	case Reply::internalServerError:
 		return boost::asio::buffer(internalServerErrorString);
+	case Reply::notImplemented:
+		return boost::asio::buffer(notImplementedString);
+	case Reply::serviceUnavailable:
+		return boost::asio::buffer(serviceUnavailableString);
 	default:
 		return boost::asio::buffer(badRequestString);
 	}
@@ -104,6 +152,12 @@ std::string ToString(Reply::status_type status) {
 		return okHTML;
 	case Reply::badRequest:
 		return badRequestHTML;
+	case Reply::lengthRequired:
+		return lengthRequiredHTML;
+	case Reply::notImplemented:
+		return notImplementedHTML;
+	case Reply::serviceUnavailable:
+		return serviceUnavailableHTML;
 	default:
 		return internalServerErrorHTML;
 	}
@@ -0,0 +1,127 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace http {
+
+//size classes grow by a factor of four, from 4 kB to 4 MB
+const static std::size_t BUFFER_POOL_SMALLEST_CLASS = 4 << 10;
+const static unsigned BUFFER_POOL_NUMBER_OF_CLASSES = 6;
+//memory that may idle in a single size class
+const static std::size_t BUFFER_POOL_BYTES_PER_CLASS = 16 << 20;
+
+/// Recycles the memory of reply bodies and compression output. Connections
+/// only hold a buffer while they answer a request, idle connections hold
+/// none. BufferT is std::string or std::vector<unsigned char>.
+template<class BufferT>
+class BufferPool : private boost::noncopyable {
+public:
+	BufferPool() : freeBuffers(BUFFER_POOL_NUMBER_OF_CLASSES) { }
+
+	/// Swaps a cleared buffer with at least minimum_capacity into buffer.
+	void Acquire(BufferT & buffer, const std::size_t minimum_capacity = 0) {
+		BOOST_ASSERT(buffer.empty());
+		{
+			boost::mutex::scoped_lock lock(poolMutex);
+			for(
+				unsigned size_class = GetSizeClassForRequest(minimum_capacity);
+				size_class < BUFFER_POOL_NUMBER_OF_CLASSES;
+				++size_class
+			) {
+				std::vector<BufferT> & free_list = freeBuffers[size_class];
+				if(!free_list.empty()) {
+					buffer.swap(free_list.back());
+					free_list.pop_back();
+					break;
+				}
+			}
+		}
+		//the largest class also holds buffers below requests beyond 4 MB
+		if(minimum_capacity <= buffer.capacity()) {
+			return;
+		}
+		buffer.reserve(
+			std::max(minimum_capacity, GetClassSize(GetSizeClassForRequest(minimum_capacity)))
+		);
+	}
+
+	/// Takes the memory of buffer back, buffer is left empty.
+	void Release(BufferT & buffer) {
+		buffer.clear();
+		const std::size_t capacity = buffer.capacity();
+		if(capacity < BUFFER_POOL_SMALLEST_CLASS) {
+			return;
+		}
+		//too large buffers are not kept, a single reply would pin the memory
+		if(GetClassSize(BUFFER_POOL_NUMBER_OF_CLASSES-1) < capacity/2) {
+			BufferT().swap(buffer);
+			return;
+		}
+		unsigned size_class = 0;
+		while(
+			size_class+1 < BUFFER_POOL_NUMBER_OF_CLASSES &&
+			GetClassSize(size_class+1) <= capacity
+		) {
+			++size_class;
+		}
+
+		boost::mutex::scoped_lock lock(poolMutex);
+		std::vector<BufferT> & free_list = freeBuffers[size_class];
+		if(BUFFER_POOL_BYTES_PER_CLASS < GetClassSize(size_class)*(free_list.size()+1)) {
+			BufferT().swap(buffer);
+			return;
+		}
+		free_list.push_back(BufferT());
+		free_list.back().swap(buffer);
+	}
+
+private:
+	static inline std::size_t GetClassSize(const unsigned size_class) {
+		return BUFFER_POOL_SMALLEST_CLASS << (2*size_class);
+	}
+
+	static inline unsigned GetSizeClassForRequest(const std::size_t capacity) {
+		unsigned size_class = 0;
+		while(
+			size_class+1 < BUFFER_POOL_NUMBER_OF_CLASSES &&
+			GetClassSize(size_class) < capacity
+		) {
+			++size_class;
+		}
+		return size_class;
+	}
+
+	boost::mutex poolMutex;
+	std::vector<std::vector<BufferT> > freeBuffers;
+};
+
+} // namespace http
+
+#endif // BUFFER_POOL_H
@@ -22,11 +22,12 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #define CONNECTION_H
 
 #include "BasicDatastructures.h"
+#include "BufferPool.h"
 #include "RequestHandler.h"
 #include "RequestParser.h"
+#include "../Util/QueryMetrics.h"
 
 #include <boost/asio.hpp>
-#include <boost/array.hpp>
 #include <boost/bind.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
@@ -34,148 +35,458 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include <zlib.h>
 
+#include <algorithm>
+#include <sstream>
 #include <vector>
 
 namespace http {
 
-/// Represents a single connection from a client.
-class Connection : public boost::enable_shared_from_this<Connection>, private boost::noncopyable {
+//compressed replies larger than this are streamed in chunks of this size
+const static std::size_t STREAMING_THRESHOLD = 64 << 10;
+const static std::size_t STREAMING_CHUNK_SIZE = 64 << 10;
+const char lastChunk[] = { '0', '\r', '\n', '\r', '\n' };
+//the receive buffer grows for large requests and shrinks back afterwards
+const static std::size_t INITIAL_RECEIVE_BUFFER_SIZE = 8 << 10;
+const static std::size_t MAX_RECEIVE_BUFFER_SIZE = MAX_REQUEST_HEADER_SIZE + MAX_REQUEST_BODY_SIZE;
+
+/// Peer address for the log, local clients have none
+inline boost::asio::ip::address remoteAddress(boost::asio::ip::tcp::socket & socket) {
+	boost::system::error_code ignoredEC;
+	return socket.remote_endpoint(ignoredEC).address();
+}
+
+/// Replies are written in one go, do not hold back their last segment
+inline void setSocketOptions(boost::asio::ip::tcp::socket & socket) {
+	boost::system::error_code ignoredEC;
+	socket.set_option(boost::asio::ip::tcp::no_delay(true), ignoredEC);
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+inline boost::asio::ip::address remoteAddress(boost::asio::local::stream_protocol::socket &) {
+	return boost::asio::ip::address_v4::loopback();
+}
+
+inline void setSocketOptions(boost::asio::local::stream_protocol::socket &) { }
+#endif
+
+/// Represents a single connection from a client. The connection is kept
+/// open for further requests if the client asks for it, requests that arrive
+/// pipelined are answered in order of arrival. ProtocolT is tcp or, for
+/// co-located clients, a Unix domain stream socket.
+template<class ProtocolT>
+class BasicConnection : public boost::enable_shared_from_this<BasicConnection<ProtocolT> >, private boost::noncopyable {
 public:
-	explicit Connection(boost::asio::io_service& io_service, RequestHandler& handler) : strand(io_service), TCPsocket(io_service), requestHandler(handler) {}
+	typedef typename ProtocolT::socket SocketType;
 
-	boost::asio::ip::tcp::socket& socket() {
-		return TCPsocket;
+	explicit BasicConnection(
+		boost::asio::io_service& io_service,
+		RequestHandler& handler,
+		BufferPool<std::string>& reply_buffer_pool,
+		BufferPool<std::vector<unsigned char> >& compression_buffer_pool,
+		const unsigned keep_alive_timeout
+	) :
+		strand(io_service),
+		clientSocket(io_service),
+		idleTimer(io_service),
+		requestHandler(handler),
+		replyBufferPool(reply_buffer_pool),
+		compressionBufferPool(compression_buffer_pool),
+		keepAliveTimeout(keep_alive_timeout),
+		incomingData(INITIAL_RECEIVE_BUFFER_SIZE),
+		compressionType(noCompression),
+		deflateStreamActive(false),
+		deflateStreamFinished(false),
+		lastChunkSent(false),
+		frontChunk(0),
+		keepAlive(false),
+		continueSent(false),
+		replyInFlight(false),
+		requestBegin(0),
+		unparsedBegin(0),
+		unparsedEnd(0),
+		replyReadyTime(0),
+		compressionTime(0)
+	{ }
+
+	~BasicConnection() {
+		releaseBuffers();
+	}
+
+	SocketType& socket() {
+		return clientSocket;
 	}
 
 	/// Start the first asynchronous operation for the connection.
 	void start() {
-	    TCPsocket.async_read_some(boost::asio::buffer(incomingDataBuffer), strand.wrap( boost::bind(&Connection::handleRead, this->shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+		setSocketOptions(clientSocket);
+		armIdleTimer();
+		readMoreData();
 	}
 
 private:
+	/// Receives behind the buffered bytes. A request has to stay contiguous
+	/// for the parser, so its start is moved to the front of the buffer and
+	/// the buffer grows to hold a large request completely.
+	void readMoreData() {
+		if (0 < requestBegin) {
+			std::copy(incomingData.begin() + requestBegin, incomingData.begin() + unparsedEnd, incomingData.begin());
+			unparsedBegin -= requestBegin;
+			unparsedEnd -= requestBegin;
+			requestBegin = 0;
+		}
+		if (incomingData.size() == unparsedEnd) {
+			const std::size_t requiredSize = unparsedEnd + requestParser.GetMissingBodyBytes();
+			incomingData.resize(std::min(MAX_RECEIVE_BUFFER_SIZE, std::max(2*incomingData.size(), requiredSize)));
+		}
+		BOOST_ASSERT(unparsedEnd < incomingData.size());
+		clientSocket.async_read_some(boost::asio::buffer(&incomingData[unparsedEnd], incomingData.size() - unparsedEnd), strand.wrap( boost::bind(&BasicConnection::handleRead, this->shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+	}
+
 	void handleRead(const boost::system::error_code& e, std::size_t bytes_transferred) {
-		if (!e) {
-			CompressionType compressionType(noCompression);
-			boost::tribool result;
-			boost::tie(result, boost::tuples::ignore) = requestParser.Parse( request, incomingDataBuffer.data(), incomingDataBuffer.data() + bytes_transferred, &compressionType);
-
-			if (result) {
-				//                std::cout << "----" << std::endl;
-				//				if(compressionType == gzipRFC1952)
-				//					std::cout << "[debug] using gzip" << std::endl;
-				//				if(compressionType == deflateRFC1951)
-				//					std::cout << "[debug] using deflate" << std::endl;
-				//				if(compressionType == noCompression)
-				//					std::cout << "[debug] no compression" << std::endl;
-			    request.endpoint = TCPsocket.remote_endpoint().address();
-				requestHandler.handle_request(request, reply);
-
-				Header compressionHeader;
-				std::vector<unsigned char> compressed;
-				std::vector<boost::asio::const_buffer> outputBuffer;
-				switch(compressionType) {
-				case deflateRFC1951:
-					compressionHeader.name = "Content-Encoding";
-					compressionHeader.value = "deflate";
-					reply.headers.insert(reply.headers.begin(), compressionHeader);   //push_back(compressionHeader);
-					compressCharArray(reply.content.c_str(), reply.content.length(), compressed, compressionType);
-					reply.setSize(compressed.size());
-					outputBuffer = reply.HeaderstoBuffers();
-					outputBuffer.push_back(boost::asio::buffer(compressed));
-					boost::asio::async_write(TCPsocket, outputBuffer, strand.wrap( boost::bind(&Connection::handleWrite, this->shared_from_this(), boost::asio::placeholders::error)));
-					break;
-				case gzipRFC1952:
-					compressionHeader.name = "Content-Encoding";
-					compressionHeader.value = "gzip";
-					reply.headers.insert(reply.headers.begin(), compressionHeader);
-					compressCharArray(reply.content.c_str(), reply.content.length(), compressed, compressionType);
-					reply.setSize(compressed.size());
-					outputBuffer = reply.HeaderstoBuffers();
-					outputBuffer.push_back(boost::asio::buffer(compressed));
-					boost::asio::async_write(TCPsocket, outputBuffer, strand.wrap( boost::bind(&Connection::handleWrite, this->shared_from_this(), boost::asio::placeholders::error)));break;
-				case noCompression:
-					boost::asio::async_write(TCPsocket, reply.toBuffers(), strand.wrap( boost::bind(&Connection::handleWrite, this->shared_from_this(), boost::asio::placeholders::error)));
-					break;
-				}
-
-			} else if (!result) {
-				reply = Reply::stockReply(Reply::badRequest);
-				boost::asio::async_write(TCPsocket, reply.toBuffers(), strand.wrap( boost::bind(&Connection::handleWrite, this->shared_from_this(), boost::asio::placeholders::error)));
-			} else {
-				TCPsocket.async_read_some(boost::asio::buffer(incomingDataBuffer), strand.wrap( boost::bind(&Connection::handleRead, this->shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+		if (e) {
+			idleTimer.cancel();
+			return;
+		}
+		unparsedEnd += bytes_transferred;
+		// the timeout covers silence, not slowly arriving large requests
+		armIdleTimer();
+		processData();
+	}
+
+	/// Parses buffered data. Bytes that follow a complete request are kept
+	/// until its reply has been written, they belong to the next request.
+	void processData() {
+		boost::tribool result;
+		char * parsedEnd;
+		char * bufferBegin = &incomingData[0];
+		boost::tie(result, parsedEnd) = requestParser.Parse( request, bufferBegin + unparsedBegin, bufferBegin + unparsedEnd, &compressionType);
+		unparsedBegin = parsedEnd - bufferBegin;
+
+		if (result) {
+			// the request is complete, no idling until the reply is out
+			replyInFlight = true;
+			idleTimer.cancel();
+			keepAlive = request.keepAlive && (0 < keepAliveTimeout);
+			request.endpoint = remoteAddress(clientSocket);
+			replyBufferPool.Acquire(reply.content);
+			// the reply may be computed on another thread, it is sent from the strand
+			requestHandler.handle_request(request, reply, strand.wrap( boost::bind(&BasicConnection::sendReply, this->shared_from_this())));
+		} else if (!result) {
+			replyInFlight = true;
+			idleTimer.cancel();
+			keepAlive = false;
+			reply = Reply::stockReply(requestParser.GetErrorStatus());
+			setConnectionHeader();
+			boost::asio::async_write(clientSocket, reply.toBuffers(), strand.wrap( boost::bind(&BasicConnection::handleWrite, this->shared_from_this(), boost::asio::placeholders::error)));
+		} else if (requestParser.ExpectsContinue() && !continueSent) {
+			// the client holds the body back until it is asked for
+			continueSent = true;
+			boost::asio::async_write(clientSocket, boost::asio::buffer(continueString), strand.wrap( boost::bind(&BasicConnection::handleContinueWrite, this->shared_from_this(), boost::asio::placeholders::error)));
+		} else {
+			readMoreData();
+		}
+	}
+
+	void handleContinueWrite(const boost::system::error_code& e) {
+		if (e) {
+			idleTimer.cancel();
+			return;
+		}
+		readMoreData();
+	}
+
+	void sendReply() {
+		replyReadyTime = QueryMetrics::GetMicroseconds();
+		Header compressionHeader;
+		std::vector<boost::asio::const_buffer> outputBuffer;
+		switch(compressionType) {
+		case deflateRFC1951:
+		case gzipRFC1952:
+			compressionHeader.name = "Content-Encoding";
+			compressionHeader.value = (gzipRFC1952 == compressionType ? "gzip" : "deflate");
+			reply.headers.insert(reply.headers.begin(), compressionHeader);
+			if (request.acceptsChunked && STREAMING_THRESHOLD < reply.content.size()) {
+				startChunkedReply();
+				break;
 			}
+			compressCharArray(reply.content.c_str(), reply.content.length(), compressed, compressionType, reply.compressionLevel);
+			compressionTime = QueryMetrics::GetMicroseconds() - replyReadyTime;
+			reply.setSize(compressed.size());
+			setConnectionHeader();
+			outputBuffer = reply.HeaderstoBuffers();
+			outputBuffer.push_back(boost::asio::buffer(compressed));
+			boost::asio::async_write(clientSocket, outputBuffer, strand.wrap( boost::bind(&BasicConnection::handleWrite, this->shared_from_this(), boost::asio::placeholders::error)));
+			break;
+		case noCompression:
+			reply.setSize(reply.content.size());
+			setConnectionHeader();
+			boost::asio::async_write(clientSocket, reply.toBuffers(), strand.wrap( boost::bind(&BasicConnection::handleWrite, this->shared_from_this(), boost::asio::placeholders::error)));
+			break;
 		}
 	}
 
+	void setConnectionHeader() {
+		reply.setHeader("Connection", (keepAlive ? "keep-alive" : "close"));
+	}
+
 	/// Handle completion of a write operation.
 	void handleWrite(const boost::system::error_code& e) {
-		if (!e) {
+		replyInFlight = false;
+		releaseBuffers();
+		if (e) {
+			return;
+		}
+		recordReplyMetrics();
+		if (!keepAlive) {
 			// Initiate graceful connection closure.
 			boost::system::error_code ignoredEC;
-			TCPsocket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignoredEC);
+			clientSocket.shutdown(SocketType::shutdown_both, ignoredEC);
+			// No new asynchronous operations are started. This means that all shared_ptr
+			// references to the connection object will disappear and the object will be
+			// destroyed automatically after this handler returns. The connection class's
+			// destructor closes the socket.
+			return;
+		}
+
+		request = Request();
+		requestParser.Reset();
+		continueSent = false;
+		reply.Reset();
+		compressionType = noCompression;
+		armIdleTimer();
+
+		// a large request does not pin its buffer while the connection idles
+		if (INITIAL_RECEIVE_BUFFER_SIZE < incomingData.size() && unparsedEnd - unparsedBegin <= INITIAL_RECEIVE_BUFFER_SIZE) {
+			std::vector<char> smallBuffer(INITIAL_RECEIVE_BUFFER_SIZE);
+			std::copy(incomingData.begin() + unparsedBegin, incomingData.begin() + unparsedEnd, smallBuffer.begin());
+			incomingData.swap(smallBuffer);
+			unparsedEnd -= unparsedBegin;
+			unparsedBegin = 0;
+		}
+		requestBegin = unparsedBegin;
+
+		if (unparsedBegin < unparsedEnd) {
+			processData();
+		} else {
+			readMoreData();
 		}
-		// No new asynchronous operations are started. This means that all shared_ptr
-		// references to the connection object will disappear and the object will be
-		// destroyed automatically after this handler returns. The connection class's
-		// destructor closes the socket.
 	}
 
-	void compressCharArray(const void *in_data, size_t in_data_size, std::vector<unsigned char> &buffer, CompressionType type) {
-		const size_t BUFSIZE = 128 * 1024;
-		unsigned char temp_buffer[BUFSIZE];
+	/// Writing spans from the reply being ready until it is sent, the time
+	/// spent compressing is not part of it.
+	void recordReplyMetrics() {
+		if (0 == replyReadyTime) {
+			return;
+		}
+		QueryMetrics & metrics = QueryMetrics::GetInstance();
+		const uint64_t elapsed = QueryMetrics::GetMicroseconds() - replyReadyTime;
+		if (noCompression != compressionType) {
+			metrics.RecordPhase(phaseCompress, reply.serviceID, compressionTime);
+		}
+		metrics.RecordPhase(phaseWrite, reply.serviceID, elapsed - std::min(elapsed, compressionTime));
+		replyReadyTime = 0;
+		compressionTime = 0;
+	}
 
-		z_stream strm;
+	/// Hands reply and compression memory back, idle connections keep none
+	void releaseBuffers() {
+		replyBufferPool.Release(reply.content);
+		compressionBufferPool.Release(compressed);
+		compressionBufferPool.Release(chunkBuffers[0]);
+		compressionBufferPool.Release(chunkBuffers[1]);
+		if (deflateStreamActive) {
+			deflateEnd(&deflateStream);
+			deflateStreamActive = false;
+		}
+	}
+
+	/// Large compressed replies are sent with chunked transfer encoding. The
+	/// next chunk is deflated while the previous one is being sent, so only
+	/// two chunks of compressed output exist at any time.
+	void startChunkedReply() {
+		initDeflateStream(deflateStream, compressionType, reply.compressionLevel);
+		deflateStream.next_in = (unsigned char *)(reply.content.c_str());
+		deflateStream.avail_in = reply.content.length();
+		deflateStreamActive = true;
+		deflateStreamFinished = false;
+		lastChunkSent = false;
+		frontChunk = 0;
+
+		for (std::vector<Header>::iterator it = reply.headers.begin(); it != reply.headers.end(); ++it) {
+			if ("Content-Length" == it->name) {
+				reply.headers.erase(it);
+				break;
+			}
+		}
+		reply.setHeader("Transfer-Encoding", "chunked");
+		setConnectionHeader();
+
+		deflateNextChunk(chunkBuffers[1-frontChunk]);
+		boost::asio::async_write(clientSocket, reply.HeaderstoBuffers(), strand.wrap( boost::bind(&BasicConnection::handleChunkWrite, this->shared_from_this(), boost::asio::placeholders::error)));
+	}
+
+	/// Sends the chunk that is ready and deflates the one after it meanwhile.
+	void handleChunkWrite(const boost::system::error_code& e) {
+		if (e || lastChunkSent) {
+			handleWrite(e);
+			return;
+		}
+		frontChunk = 1-frontChunk;
+		std::vector<unsigned char> & chunk = chunkBuffers[frontChunk];
+
+		std::vector<boost::asio::const_buffer> outputBuffer;
+		if (!chunk.empty()) {
+			std::ostringstream size_line;
+			size_line << std::hex << chunk.size() << "\r\n";
+			chunkSizeLine = size_line.str();
+			outputBuffer.push_back(boost::asio::buffer(chunkSizeLine));
+			outputBuffer.push_back(boost::asio::buffer(chunk));
+			outputBuffer.push_back(boost::asio::buffer(crlf));
+		}
+		if (deflateStreamFinished) {
+			outputBuffer.push_back(boost::asio::buffer(lastChunk));
+			lastChunkSent = true;
+		}
+		boost::asio::async_write(clientSocket, outputBuffer, strand.wrap( boost::bind(&BasicConnection::handleChunkWrite, this->shared_from_this(), boost::asio::placeholders::error)));
+
+		if (!deflateStreamFinished) {
+			deflateNextChunk(chunkBuffers[1-frontChunk]);
+		}
+	}
+
+	void deflateNextChunk(std::vector<unsigned char> & chunk) {
+		const uint64_t deflateStart = QueryMetrics::GetMicroseconds();
+		if (chunk.capacity() < STREAMING_CHUNK_SIZE) {
+			compressionBufferPool.Acquire(chunk, STREAMING_CHUNK_SIZE);
+		}
+		chunk.resize(STREAMING_CHUNK_SIZE);
+		deflateStream.next_out = &chunk[0];
+		deflateStream.avail_out = chunk.size();
+		//all input is present, Z_FINISH produces output until chunk is full
+		const int deflate_res = deflate(&deflateStream, Z_FINISH);
+		BOOST_ASSERT(Z_OK == deflate_res || Z_STREAM_END == deflate_res || Z_BUF_ERROR == deflate_res);
+		chunk.resize(STREAMING_CHUNK_SIZE - deflateStream.avail_out);
+		if (Z_STREAM_END == deflate_res) {
+			deflateStreamFinished = true;
+		}
+		compressionTime += QueryMetrics::GetMicroseconds() - deflateStart;
+	}
+
+	void armIdleTimer() {
+		if (0 == keepAliveTimeout) {
+			return;
+		}
+		idleTimer.expires_from_now(boost::posix_time::seconds(keepAliveTimeout));
+		idleTimer.async_wait(strand.wrap( boost::bind(&BasicConnection::handleIdleTimeout, this->shared_from_this(), boost::asio::placeholders::error)));
+	}
+
+	/// Closes connections that sent nothing for keepAliveTimeout seconds
+	/// while a request was awaited. This aborts the pending read, which
+	/// releases the connection.
+	void handleIdleTimeout(const boost::system::error_code& e) {
+		if (e || idleTimer.expires_at() > boost::asio::deadline_timer::traits_type::now()) {
+			// timer was cancelled or rearmed meanwhile
+			return;
+		}
+		if (replyInFlight) {
+			// expired just before the request completed, cancel() came too late
+			return;
+		}
+		boost::system::error_code ignoredEC;
+		clientSocket.shutdown(SocketType::shutdown_both, ignoredEC);
+		clientSocket.close(ignoredEC);
+	}
+
+	/// A negative level selects the default of the encoding
+	static void initDeflateStream(z_stream & strm, CompressionType type, int level) {
 		strm.zalloc = Z_NULL;
 		strm.zfree = Z_NULL;
 		strm.opaque = Z_NULL;
 		strm.total_out = 0;
-		strm.next_in = (unsigned char *)(in_data);
-		strm.avail_in = in_data_size;
-		strm.next_out = temp_buffer;
-		strm.avail_out = BUFSIZE;
 		strm.data_type = Z_ASCII;
 
 		switch(type){
 		case deflateRFC1951:
-			deflateInit(&strm, Z_BEST_SPEED);
+			deflateInit(&strm, (0 > level ? Z_BEST_SPEED : level));
 			break;
 		case gzipRFC1952:
 			/*
 			 * Big thanks to deusty who explains how to have gzip compression turned on by the right call to deflateInit2():
 			 * http://deusty.blogspot.com/2007/07/gzip-compressiondecompression.html
 			 */
-			deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, (15+16), 9, Z_DEFAULT_STRATEGY);
+			deflateInit2(&strm, (0 > level ? Z_DEFAULT_COMPRESSION : level), Z_DEFLATED, (15+16), 9, Z_DEFAULT_STRATEGY);
 			break;
 		default:
 			assert(false);
 			break;
 		}
+	}
+
+	/// Deflates straight into a pooled buffer that is sized by deflateBound()
+	void compressCharArray(const void *in_data, size_t in_data_size, std::vector<unsigned char> &buffer, CompressionType type, int level) {
+		z_stream strm;
+		initDeflateStream(strm, type, level);
+		strm.next_in = (unsigned char *)(in_data);
+		strm.avail_in = in_data_size;
+
+		//the bound does not cover the gzip wrapper in all zlib versions
+		const size_t bound = deflateBound(&strm, in_data_size) + 32;
+		compressionBufferPool.Acquire(buffer, bound);
+		buffer.resize(bound);
+		strm.next_out = &buffer[0];
+		strm.avail_out = buffer.size();
 
 		int deflate_res = Z_OK;
 		do {
 			if (strm.avail_out == 0) {
-				buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE);
-				strm.next_out = temp_buffer;
-				strm.avail_out = BUFSIZE;
+				const size_t used = buffer.size();
+				buffer.resize(2*used);
+				strm.next_out = &buffer[used];
+				strm.avail_out = buffer.size() - used;
 			}
 			deflate_res = deflate(&strm, Z_FINISH);
-
 		} while (deflate_res == Z_OK);
 
 		assert(deflate_res == Z_STREAM_END);
-		buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE - strm.avail_out);
+		buffer.resize(strm.total_out);
 		deflateEnd(&strm);
 	}
 
 	boost::asio::io_service::strand strand;
-	boost::asio::ip::tcp::socket TCPsocket;
+	SocketType clientSocket;
+	boost::asio::deadline_timer idleTimer;
 	RequestHandler& requestHandler;
-	boost::array<char, 8192> incomingDataBuffer;
+	BufferPool<std::string>& replyBufferPool;
+	BufferPool<std::vector<unsigned char> >& compressionBufferPool;
+	const unsigned keepAliveTimeout;
+	std::vector<char> incomingData;
 	Request request;
 	RequestParser requestParser;
 	Reply reply;
+	CompressionType compressionType;
+	std::vector<unsigned char> compressed;
+	z_stream deflateStream;
+	bool deflateStreamActive;
+	bool deflateStreamFinished;
+	bool lastChunkSent;
+	unsigned frontChunk;
+	std::vector<unsigned char> chunkBuffers[2];
+	std::string chunkSizeLine;
+	bool keepAlive;
+	bool continueSent;
+	bool replyInFlight;
+	std::size_t requestBegin;
+	std::size_t unparsedBegin;
+	std::size_t unparsedEnd;
+	uint64_t replyReadyTime;
+	uint64_t compressionTime;
 };
 
+typedef BasicConnection<boost::asio::ip::tcp> Connection;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+typedef BasicConnection<boost::asio::local::stream_protocol> LocalConnection;
+#endif
+
 } // namespace http
 
 #endif // CONNECTION_H
@@ -28,8 +28,16 @@ QueryObjectsStorage::QueryObjectsStorage(
 	const std::string & nodesPath,
 	const std::string & edgesPath,
 	const std::string & namesPath,
-	const std::string & timestampPath
-) {
+	const std::string & timestampPath,
+	const std::string & gridIndexPath,
+	const unsigned phantomNodeCacheSize,
+	const unsigned phantomNodeCacheResolution,
+	const bool compressEdgeRecords
+) :
+	graph(NULL),
+	sharedDataRegion(NULL),
+	datasetContainer(NULL)
+{
 	if( hsgrPath.empty() ) {
 		throw OSRMException("no hsgr file given in ini file");
 	}
@@ -49,22 +57,255 @@ QueryObjectsStorage::QueryObjectsStorage(
 		throw OSRMException("no names file given in ini file");
 	}
 
-	SimpleLogger().Write() << "loading graph data";
-	//Deserialize road network graph
+	//the files are independent and read at the same time
+	ConcurrentLoader loader;
 	std::vector< QueryGraph::_StrNode> nodeList;
 	std::vector< QueryGraph::_StrEdge> edgeList;
-	const int n = readHSGRFromStream(
-		hsgrPath,
-		nodeList,
-		edgeList,
-		&checkSum
+	unsigned n = 0;
+	HSGRHeader hsgrHeader;
+	if( readHSGRHeader(hsgrPath, hsgrHeader) ) {
+		SimpleLogger().Write() << "mapping graph data";
+		if( boost::filesystem::file_size(hsgrPath) <
+			hsgrHeader.GetFileSize<QueryGraph::_StrEdge>()
+		) {
+			throw OSRMException("hsgr file is truncated");
+		}
+		//the page cache is shared by all processes that map the file
+		boost::interprocess::file_mapping fileMapping(
+			hsgrPath.c_str(),
+			boost::interprocess::read_only
+		);
+		boost::interprocess::mapped_region region(
+			fileMapping,
+			boost::interprocess::read_only
+		);
+		hsgrFileMapping.swap(fileMapping);
+		hsgrRegion.swap(region);
+
+		const char * base = static_cast<const char *>(hsgrRegion.get_address());
+		checkSum = hsgrHeader.check_sum;
+		n = hsgrHeader.number_of_nodes + 1;
+		graph = new QueryGraph(
+			reinterpret_cast<const QueryGraph::_StrNode *>(base + hsgrHeader.node_offset),
+			hsgrHeader.number_of_nodes,
+			reinterpret_cast<const QueryGraph::_StrEdge *>(base + hsgrHeader.edge_offset),
+			hsgrHeader.number_of_edges
+		);
+	} else {
+		SimpleLogger().Write(logWARNING) <<
+			".hsgr has an old format and is copied into memory. "
+			"Reprocess to map it in place.";
+		loader.Add(
+			"graph",
+			boost::bind(
+				&QueryObjectsStorage::LoadGraph,
+				hsgrPath,
+				boost::ref(nodeList),
+				boost::ref(edgeList),
+				&n,
+				&checkSum
+			)
+		);
+	}
+
+	StaticRTree<RTreeLeaf> * rtree = NULL;
+	loader.Add(
+		"search tree",
+		boost::bind(
+			&QueryObjectsStorage::LoadSearchTree,
+			ramIndexPath,
+			fileIndexPath,
+			gridIndexPath,
+			&rtree
+		)
+	);
+	std::vector<NodeInformationHelpDesk::OriginalEdgeRecord> edgeRecords;
+	loader.Add(
+		"edge records",
+		boost::bind(
+			&NodeInformationHelpDesk::LoadEdgeRecords,
+			nodesPath,
+			edgesPath,
+			boost::ref(edgeRecords)
+		)
+	);
+	loader.Add("names", boost::bind(&NameTable::Load, &names, namesPath));
+	try {
+		loader.Run();
+	} catch(...) {
+		delete rtree;
+		delete graph;
+		throw;
+	}
+
+	if( NULL == graph ) {
+		graph = new QueryGraph(nodeList, edgeList);
+		assert(0 == nodeList.size());
+		assert(0 == edgeList.size());
+	}
+	SimpleLogger().Write() << "Data checksum is " << checkSum;
+
+	LoadTimestamp(timestampPath, timestamp);
+
+	nodeHelpDesk = new NodeInformationHelpDesk(
+		rtree,
+		edgeRecords,
+		n,
+		checkSum,
+		phantomNodeCacheSize,
+		phantomNodeCacheResolution,
+		compressEdgeRecords
+	);
+	SimpleLogger().Write() << "All query data structures loaded";
+}
+
+QueryObjectsStorage::QueryObjectsStorage(
+	SharedDataRegion * region,
+	const unsigned phantomNodeCacheSize,
+	const unsigned phantomNodeCacheResolution
+) :
+	sharedDataRegion(region),
+	datasetContainer(NULL)
+{
+	const SharedDataLayout & layout = sharedDataRegion->GetLayout();
+	const char * begin = sharedDataRegion->GetBegin();
+	checkSum = layout.check_sum;
+	SimpleLogger().Write() << "Data checksum is " << checkSum;
+
+	//the node array holds a sentinel behind the last node
+	graph = new QueryGraph(
+		layout.GetBlockPointer<QueryGraph::_StrNode>(begin, SharedDataLayout::GRAPH_NODES),
+		layout.number_of_entries[SharedDataLayout::GRAPH_NODES] - 1,
+		layout.GetBlockPointer<QueryGraph::_StrEdge>(begin, SharedDataLayout::GRAPH_EDGES),
+		layout.number_of_entries[SharedDataLayout::GRAPH_EDGES]
+	);
+
+	StaticRTree<RTreeLeaf> * rtree = new StaticRTree<RTreeLeaf>(
+		layout.GetBlockPointer<StaticRTree<RTreeLeaf>::SearchTreeNode>(begin, SharedDataLayout::RTREE_NODES),
+		layout.GetBlockPointer<uint64_t>(begin, SharedDataLayout::RTREE_LEAF_OFFSETS),
+		layout.number_of_entries[SharedDataLayout::RTREE_LEAF_OFFSETS],
+		layout.GetString(begin, SharedDataLayout::RTREE_LEAF_FILENAME),
+		layout.GetString(begin, SharedDataLayout::GRID_INDEX_FILENAME)
+	);
+	nodeHelpDesk = new NodeInformationHelpDesk(
+		rtree,
+		layout.GetBlockPointer<NodeInformationHelpDesk::OriginalEdgeRecord>(begin, SharedDataLayout::EDGE_RECORDS),
+		layout.number_of_entries[SharedDataLayout::EDGE_RECORDS],
+		layout.number_of_nodes,
+		checkSum,
+		phantomNodeCacheSize,
+		phantomNodeCacheResolution
+	);
+
+	names.View(
+		layout.GetBlockPointer<uint32_t>(begin, SharedDataLayout::NAME_OFFSETS),
+		layout.GetBlockPointer<char>(begin, SharedDataLayout::NAME_CHARACTERS),
+		layout.number_of_entries[SharedDataLayout::NAME_OFFSETS] - 1
 	);
 
+	timestamp = layout.GetString(begin, SharedDataLayout::TIMESTAMP);
+	SimpleLogger().Write() << "All query data structures attached";
+}
+
+QueryObjectsStorage::QueryObjectsStorage(
+	DatasetContainer * container,
+	const unsigned phantomNodeCacheSize,
+	const unsigned phantomNodeCacheResolution
+) :
+	sharedDataRegion(NULL),
+	datasetContainer(container)
+{
+	checkSum = datasetContainer->GetCheckSum();
 	SimpleLogger().Write() << "Data checksum is " << checkSum;
-	graph = new QueryGraph(nodeList, edgeList);
-	assert(0 == nodeList.size());
-	assert(0 == edgeList.size());
 
+	//the node array holds a sentinel behind the last node
+	graph = new QueryGraph(
+		datasetContainer->GetSection<QueryGraph::_StrNode>(DatasetSection::GRAPH_NODES),
+		datasetContainer->GetNumberOfEntries<QueryGraph::_StrNode>(DatasetSection::GRAPH_NODES) - 1,
+		datasetContainer->GetSection<QueryGraph::_StrEdge>(DatasetSection::GRAPH_EDGES),
+		datasetContainer->GetNumberOfEntries<QueryGraph::_StrEdge>(DatasetSection::GRAPH_EDGES)
+	);
+
+	LeafGridIndex * gridIndex = NULL;
+	if( 0 < datasetContainer->GetSectionSize(DatasetSection::GRID_INDEX) ) {
+		gridIndex = new LeafGridIndex(
+			datasetContainer->GetSection<char>(DatasetSection::GRID_INDEX),
+			datasetContainer->GetSectionSize(DatasetSection::GRID_INDEX)
+		);
+	}
+	StaticRTree<RTreeLeaf> * rtree = new StaticRTree<RTreeLeaf>(
+		datasetContainer->GetSection<StaticRTree<RTreeLeaf>::SearchTreeNode>(DatasetSection::RTREE_NODES),
+		datasetContainer->GetSection<uint64_t>(DatasetSection::RTREE_LEAF_OFFSETS),
+		datasetContainer->GetNumberOfEntries<uint64_t>(DatasetSection::RTREE_LEAF_OFFSETS),
+		datasetContainer->GetSection<char>(DatasetSection::RTREE_LEAFS),
+		gridIndex
+	);
+	nodeHelpDesk = new NodeInformationHelpDesk(
+		rtree,
+		datasetContainer->GetSection<NodeInformationHelpDesk::OriginalEdgeRecord>(DatasetSection::EDGE_RECORDS),
+		datasetContainer->GetNumberOfEntries<NodeInformationHelpDesk::OriginalEdgeRecord>(DatasetSection::EDGE_RECORDS),
+		datasetContainer->GetNumberOfNodes(),
+		checkSum,
+		phantomNodeCacheSize,
+		phantomNodeCacheResolution
+	);
+
+	const char * namesBegin = datasetContainer->GetSection<char>(DatasetSection::NAMES);
+	names.Parse(
+		namesBegin,
+		namesBegin + datasetContainer->GetSectionSize(DatasetSection::NAMES)
+	);
+
+	//the section holds the whole .timestamp file, only its first line counts
+	timestamp = datasetContainer->GetString(DatasetSection::TIMESTAMP);
+	timestamp = timestamp.substr(0, timestamp.find('\n'));
+	NormalizeTimestamp(timestamp);
+	SimpleLogger().Write() << "All query data structures attached";
+}
+
+QueryObjectsStorage::~QueryObjectsStorage() {
+	//        delete names;
+	delete graph;
+	delete nodeHelpDesk;
+	delete sharedDataRegion;
+	delete datasetContainer;
+}
+
+void QueryObjectsStorage::LoadGraph(
+	const std::string & hsgrPath,
+	std::vector<QueryGraph::_StrNode> & nodeList,
+	std::vector<QueryGraph::_StrEdge> & edgeList,
+	unsigned * numberOfNodes,
+	unsigned * checkSum
+) {
+	*numberOfNodes = readHSGRFromStream(hsgrPath, nodeList, edgeList, checkSum);
+}
+
+void QueryObjectsStorage::LoadSearchTree(
+	const std::string & ramIndexPath,
+	const std::string & fileIndexPath,
+	const std::string & gridIndexPath,
+	StaticRTree<RTreeLeaf> ** rtree
+) {
+	*rtree = new StaticRTree<RTreeLeaf>(ramIndexPath, fileIndexPath, gridIndexPath);
+}
+
+void QueryObjectsStorage::AdviseHugePages() const {
+	graph->AdviseHugePages();
+	nodeHelpDesk->AdviseHugePages();
+	//views into shared memory or into a container are covered as a whole
+	if( NULL != sharedDataRegion ) {
+		sharedDataRegion->AdviseHugePages();
+	}
+	if( NULL != datasetContainer ) {
+		datasetContainer->AdviseHugePages();
+	}
+}
+
+void QueryObjectsStorage::LoadTimestamp(
+	const std::string & timestampPath,
+	std::string & timestamp
+) {
 	if(timestampPath.length()) {
 	    SimpleLogger().Write() << "Loading Timestamp";
 	    std::ifstream timestampInStream(timestampPath.c_str());
@@ -75,56 +316,14 @@ QueryObjectsStorage::QueryObjectsStorage(
 	    getline(timestampInStream, timestamp);
 	    timestampInStream.close();
 	}
+	NormalizeTimestamp(timestamp);
+}
+
+void QueryObjectsStorage::NormalizeTimestamp(std::string & timestamp) {
 	if(!timestamp.length()) {
 	    timestamp = "n/a";
 	}
 	if(25 < timestamp.length()) {
 	    timestamp.resize(25);
 	}
-
-    SimpleLogger().Write() << "Loading auxiliary information";
-    //Init nearest neighbor data structure
-	nodeHelpDesk = new NodeInformationHelpDesk(
-		ramIndexPath,
-		fileIndexPath,
-		nodesPath,
-		edgesPath,
-		n,
-		checkSum
-	);
-
-	//deserialize street name list
-	SimpleLogger().Write() << "Loading names index";
-	boost::filesystem::path names_file(namesPath);
-
-    if ( !boost::filesystem::exists( names_file ) ) {
-        throw OSRMException("names file does not exist");
-    }
-    if ( 0 == boost::filesystem::file_size( names_file ) ) {
-        throw OSRMException("names file is empty");
-    }
-
-	boost::filesystem::ifstream name_stream(names_file, std::ios::binary);
-	unsigned size = 0;
-	name_stream.read((char *)&size, sizeof(unsigned));
-	BOOST_ASSERT_MSG(0 != size, "name file empty");
-
-	char buf[1024];
-	for( unsigned i = 0; i < size; ++i ) {
-		unsigned size_of_string = 0;
-		name_stream.read((char *)&size_of_string, sizeof(unsigned));
-		buf[size_of_string] = '\0'; // instead of memset
-		name_stream.read(buf, size_of_string);
-		names.push_back(buf);
-	}
-	std::vector<std::string>(names).swap(names);
-	BOOST_ASSERT_MSG(0 != names.size(), "could not load any names");
-	name_stream.close();
-	SimpleLogger().Write() << "All query data structures loaded";
-}
-
-QueryObjectsStorage::~QueryObjectsStorage() {
-	//        delete names;
-	delete graph;
-	delete nodeHelpDesk;
 }
@@ -22,9 +22,13 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #ifndef QUERYOBJECTSSTORAGE_H_
 #define QUERYOBJECTSSTORAGE_H_
 
+#include "SharedDataLayout.h"
+#include "../../Util/DatasetContainer.h"
+#include "../../Util/FileLoader.h"
 #include "../../Util/GraphLoader.h"
 #include "../../Util/OSRMException.h"
 #include "../../Util/SimpleLogger.h"
+#include "../../DataStructures/NameTable.h"
 #include "../../DataStructures/NodeInformationHelpDesk.h"
 #include "../../DataStructures/QueryEdge.h"
 #include "../../DataStructures/StaticGraph.h"
@@ -32,6 +36,8 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #include <boost/assert.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include <vector>
 #include <string>
@@ -42,10 +48,13 @@ struct QueryObjectsStorage {
     typedef QueryGraph::InputEdge               InputEdge;
 
     NodeInformationHelpDesk * nodeHelpDesk;
-    std::vector<std::string> names;
+    NameTable names;
     QueryGraph * graph;
     std::string timestamp;
     unsigned checkSum;
+    //graphs in the current .hsgr format are viewed in place
+    boost::interprocess::file_mapping hsgrFileMapping;
+    boost::interprocess::mapped_region hsgrRegion;
 
     QueryObjectsStorage(
         const std::string & hsgrPath,
@@ -54,10 +63,58 @@ struct QueryObjectsStorage {
         const std::string & nodesPath,
         const std::string & edgesPath,
         const std::string & namesPath,
-        const std::string & timestampPath
+        const std::string & timestampPath,
+        const std::string & gridIndexPath,
+        const unsigned phantomNodeCacheSize,
+        const unsigned phantomNodeCacheResolution,
+        const bool compressEdgeRecords = false
+    );
+
+    //views the dataset that osrm-datastore loaded into shared memory and
+    //takes ownership of the region
+    QueryObjectsStorage(
+        SharedDataRegion * region,
+        const unsigned phantomNodeCacheSize,
+        const unsigned phantomNodeCacheResolution
+    );
+
+    //views the sections of a dataset container and takes ownership of it
+    QueryObjectsStorage(
+        DatasetContainer * container,
+        const unsigned phantomNodeCacheSize,
+        const unsigned phantomNodeCacheResolution
     );
 
     ~QueryObjectsStorage();
+
+    //asks for huge pages behind the graph, the edge records and the r-tree
+    void AdviseHugePages() const;
+
+    static void LoadTimestamp(
+        const std::string & timestampPath,
+        std::string & timestamp
+    );
+
+
+private:
+    static void NormalizeTimestamp(std::string & timestamp);
+    //loading steps that run concurrently
+    static void LoadGraph(
+        const std::string & hsgrPath,
+        std::vector<QueryGraph::_StrNode> & nodeList,
+        std::vector<QueryGraph::_StrEdge> & edgeList,
+        unsigned * numberOfNodes,
+        unsigned * checkSum
+    );
+    static void LoadSearchTree(
+        const std::string & ramIndexPath,
+        const std::string & fileIndexPath,
+        const std::string & gridIndexPath,
+        StaticRTree<RTreeLeaf> ** rtree
+    );
+
+    SharedDataRegion * sharedDataRegion;
+    DatasetContainer * datasetContainer;
 };
 
 #endif /* QUERYOBJECTSSTORAGE_H_ */
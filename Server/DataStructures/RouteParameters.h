@@ -23,6 +23,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include "../../DataStructures/Coordinate.h"
 #include "../../DataStructures/HashTable.h"
+#include "../../DataStructures/PhantomNodes.h"
 
 #include <boost/fusion/container/vector.hpp>
 #include <boost/fusion/sequence/intrinsic.hpp>
@@ -48,13 +49,35 @@ struct RouteParameters {
     bool deprecatedAPI;
     unsigned checkSum;
     std::string service;
+    //data set to answer from, empty for the default one
+    std::string profile;
     std::string outputFormat;
     std::string jsonpParameter;
     std::string language;
     std::vector<std::string> hints;
+    std::vector<BearingFilter> bearings;
     std::vector<FixedPointCoordinate> coordinates;
     typedef HashTable<std::string, std::string>::const_iterator OptionsIterator;
 
+    //readies a reused object for the next request, keeps allocated memory
+    void Reset() {
+        zoomLevel = 18;
+        printInstructions = false;
+        alternateRoute = true;
+        geometry = true;
+        compression = true;
+        deprecatedAPI = false;
+        checkSum = -1;
+        service.clear();
+        profile.clear();
+        outputFormat.clear();
+        jsonpParameter.clear();
+        language.clear();
+        hints.clear();
+        bearings.clear();
+        coordinates.clear();
+    }
+
     void setZoomLevel(const short i) {
         if (18 > i && 0 < i) {
             zoomLevel = i;
@@ -81,6 +104,10 @@ struct RouteParameters {
         service = s;
     }
 
+    void setProfile( const std::string & s) {
+        profile = s;
+    }
+
     void setOutputFormat(const std::string & s) {
         outputFormat = s;
     }
@@ -90,10 +117,31 @@ struct RouteParameters {
     }
 
     void addHint(const std::string & s) {
+        //a hint belongs to the preceding coordinate
+        if( coordinates.empty() ) {
+            return;
+        }
         hints.resize(coordinates.size());
         hints.back() = s;
     }
 
+    void addBearing(const boost::fusion::vector < int, int > & arg_) {
+        const int bearing = boost::fusion::at_c < 0 > (arg_);
+        const int range = boost::fusion::at_c < 1 > (arg_);
+        if( coordinates.empty() || 0 > bearing || 360 <= bearing || 0 > range ) {
+            return;
+        }
+        bearings.resize(coordinates.size());
+        bearings.back() = BearingFilter(bearing, range);
+    }
+
+    BearingFilter getBearingFilter(const unsigned i) const {
+        if( i < bearings.size() ) {
+            return bearings[i];
+        }
+        return BearingFilter();
+    }
+
     void setLanguage(const std::string & s) {
         language = s;
     }
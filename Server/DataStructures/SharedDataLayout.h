@@ -0,0 +1,281 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef SHAREDDATALAYOUT_H_
+#define SHAREDDATALAYOUT_H_
+
+#include "../../Util/MemoryPlacement.h"
+#include "../../Util/OSRMException.h"
+#include "../../Util/SimpleLogger.h"
+
+#include <boost/assert.hpp>
+#include <boost/atomic.hpp>
+#include <boost/integer.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+
+const static unsigned SHARED_DATA_MAGIC_NUMBER = 0x4d485344;
+const static unsigned SHARED_DATA_VERSION = 1;
+const static uint64_t SHARED_DATA_BLOCK_ALIGNMENT = 64;
+//the published dataset alternates between two regions, a new one is
+//loaded into the region that is not being served
+const static unsigned NUMBER_OF_SHARED_DATA_REGIONS = 2;
+const static char SHARED_DATA_CONTROL_NAME[] = "osrm-datastore";
+const static char SHARED_DATA_REGION_PREFIX[] = "osrm-datastore-region-";
+
+// Sizes and offsets of the arrays of a dataset in shared memory. The layout
+// is the first thing in a region, the blocks follow aligned to cache lines.
+struct SharedDataLayout {
+    enum BlockID {
+        GRAPH_NODES = 0,
+        GRAPH_EDGES,
+        EDGE_RECORDS,
+        RTREE_NODES,
+        RTREE_LEAF_OFFSETS,
+        NAME_OFFSETS,
+        NAME_CHARACTERS,
+        TIMESTAMP,
+        RTREE_LEAF_FILENAME,
+        GRID_INDEX_FILENAME,
+        NUMBER_OF_BLOCKS
+    };
+
+    SharedDataLayout() :
+        magic_number(SHARED_DATA_MAGIC_NUMBER),
+        version(SHARED_DATA_VERSION),
+        check_sum(0),
+        number_of_nodes(0)
+    {
+        for( unsigned i = 0; i < NUMBER_OF_BLOCKS; ++i ) {
+            number_of_entries[i] = 0;
+            block_offset[i] = 0;
+            block_size[i] = 0;
+        }
+    }
+
+    template<typename T>
+    void SetBlockSize(const BlockID block, const uint64_t entries) {
+        number_of_entries[block] = entries;
+        block_size[block] = entries*sizeof(T);
+        uint64_t offset = sizeof(SharedDataLayout);
+        for( unsigned i = 0; i < NUMBER_OF_BLOCKS; ++i ) {
+            offset = (offset + SHARED_DATA_BLOCK_ALIGNMENT - 1) /
+                SHARED_DATA_BLOCK_ALIGNMENT * SHARED_DATA_BLOCK_ALIGNMENT;
+            block_offset[i] = offset;
+            offset += block_size[i];
+        }
+    }
+
+    uint64_t GetRegionSize() const {
+        return block_offset[NUMBER_OF_BLOCKS-1] + block_size[NUMBER_OF_BLOCKS-1];
+    }
+
+    template<typename T>
+    T * GetBlockPointer(char * region_begin, const BlockID block) const {
+        return reinterpret_cast<T *>(region_begin + block_offset[block]);
+    }
+
+    template<typename T>
+    const T * GetBlockPointer(const char * region_begin, const BlockID block) const {
+        return reinterpret_cast<const T *>(region_begin + block_offset[block]);
+    }
+
+    std::string GetString(const char * region_begin, const BlockID block) const {
+        const char * begin = GetBlockPointer<char>(region_begin, block);
+        return std::string(begin, begin + number_of_entries[block]);
+    }
+
+    uint32_t magic_number;
+    uint32_t version;
+    uint32_t check_sum;
+    uint32_t number_of_nodes;
+    uint64_t number_of_entries[NUMBER_OF_BLOCKS];
+    uint64_t block_offset[NUMBER_OF_BLOCKS];
+    uint64_t block_size[NUMBER_OF_BLOCKS];
+};
+
+// Tells attaching processes which region holds the current dataset.
+// osrm-datastore bumps the generation after it switched regions. Only
+// written by SharedDataRegion::PublishControl and read by ReadControl.
+struct SharedDataControl {
+    uint32_t magic_number;
+    uint32_t current_region;
+    uint64_t generation;
+};
+
+inline std::string GetSharedDataRegionName(const unsigned region) {
+    BOOST_ASSERT(region < NUMBER_OF_SHARED_DATA_REGIONS);
+    return SHARED_DATA_REGION_PREFIX + std::string(1, char('0' + region));
+}
+
+// Read-only view of the dataset that is current at construction time. The
+// region stays valid while it is mapped, even if osrm-datastore replaces
+// it in the meantime.
+class SharedDataRegion : boost::noncopyable {
+public:
+    SharedDataRegion() {
+        //osrm-datastore only rewrites a region after it published the other
+        //one, so the mapping is consistent if the control did not change
+        //while it was opened, like the read side of a seqlock.
+        SharedDataControl control;
+        for( unsigned attempt = 0; ; ++attempt ) {
+            if( !ReadControl(control) ) {
+                throw OSRMException("no dataset in shared memory, run osrm-datastore");
+            }
+            const bool is_mapped = MapRegion(control.current_region);
+            SharedDataControl control_after_mapping;
+            if(
+                ReadControl(control_after_mapping) &&
+                control_after_mapping.generation == control.generation &&
+                control_after_mapping.current_region == control.current_region
+            ) {
+                if( !is_mapped ) {
+                    throw OSRMException("shared memory region of the dataset is missing");
+                }
+                break;
+            }
+            if( attempt + 1 >= MAXIMUM_NUMBER_OF_ATTACH_ATTEMPTS ) {
+                throw OSRMException("dataset in shared memory keeps changing while attaching");
+            }
+            SimpleLogger().Write(logDEBUG) << "dataset in shared memory " <<
+                "changed while attaching, retrying";
+        }
+        generation = control.generation;
+        if( mapped_region.get_size() < sizeof(SharedDataLayout) ) {
+            throw OSRMException("shared memory region is truncated");
+        }
+        const SharedDataLayout & layout = GetLayout();
+        if(
+            SHARED_DATA_MAGIC_NUMBER != layout.magic_number ||
+            SHARED_DATA_VERSION != layout.version
+        ) {
+            throw OSRMException("shared memory region has an unknown format");
+        }
+        if( mapped_region.get_size() < layout.GetRegionSize() ) {
+            throw OSRMException("shared memory region is truncated");
+        }
+        SimpleLogger().Write() << "attached to " <<
+            GetSharedDataRegionName(control.current_region) <<
+            ", generation " << generation;
+    }
+
+    //false if osrm-datastore did not publish a dataset yet
+    static bool ReadControl(SharedDataControl & control) {
+        try {
+            boost::interprocess::shared_memory_object control_object(
+                boost::interprocess::open_only,
+                SHARED_DATA_CONTROL_NAME,
+                boost::interprocess::read_only
+            );
+            boost::interprocess::mapped_region control_region(
+                control_object,
+                boost::interprocess::read_only
+            );
+            if( control_region.get_size() < sizeof(SharedDataControl) ) {
+                return false;
+            }
+            const volatile SharedDataControl * published_control =
+                static_cast<const volatile SharedDataControl *>(control_region.get_address());
+            //the reverse order of PublishControl, a torn read changes the
+            //generation or finds the magic number cleared
+            for( unsigned attempt = 0; attempt < MAXIMUM_NUMBER_OF_ATTACH_ATTEMPTS; ++attempt ) {
+                const uint64_t generation_before = published_control->generation;
+                boost::atomic_thread_fence(boost::memory_order_seq_cst);
+                control.current_region = published_control->current_region;
+                boost::atomic_thread_fence(boost::memory_order_seq_cst);
+                control.magic_number = published_control->magic_number;
+                boost::atomic_thread_fence(boost::memory_order_seq_cst);
+                control.generation = published_control->generation;
+                if(
+                    generation_before == control.generation &&
+                    SHARED_DATA_MAGIC_NUMBER == control.magic_number
+                ) {
+                    return control.current_region < NUMBER_OF_SHARED_DATA_REGIONS;
+                }
+                boost::this_thread::yield();
+            }
+        } catch(const boost::interprocess::interprocess_exception &) {
+        }
+        return false;
+    }
+
+    //Used by osrm-datastore. The magic number is cleared while the region
+    //and generation change, so ReadControl never returns a mix of both.
+    static void PublishControl(
+        volatile SharedDataControl * published_control,
+        const unsigned current_region,
+        const uint64_t generation
+    ) {
+        published_control->magic_number = 0;
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        published_control->current_region = current_region;
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        published_control->generation = generation;
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        published_control->magic_number = SHARED_DATA_MAGIC_NUMBER;
+    }
+
+    const SharedDataLayout & GetLayout() const {
+        return *static_cast<const SharedDataLayout *>(mapped_region.get_address());
+    }
+
+    const char * GetBegin() const {
+        return static_cast<const char *>(mapped_region.get_address());
+    }
+
+    uint64_t GetGeneration() const {
+        return generation;
+    }
+
+    void AdviseHugePages() const {
+        ::AdviseHugePages(mapped_region.get_address(), mapped_region.get_size());
+    }
+
+private:
+    const static unsigned MAXIMUM_NUMBER_OF_ATTACH_ATTEMPTS = 16;
+
+    //false if the region is missing, e.g. while osrm-datastore recreates it
+    bool MapRegion(const unsigned region) {
+        try {
+            boost::interprocess::shared_memory_object region_object(
+                boost::interprocess::open_only,
+                GetSharedDataRegionName(region).c_str(),
+                boost::interprocess::read_only
+            );
+            boost::interprocess::mapped_region new_region(
+                region_object,
+                boost::interprocess::read_only
+            );
+            mapped_region.swap(new_region);
+        } catch(const boost::interprocess::interprocess_exception &) {
+            return false;
+        }
+        return true;
+    }
+
+    boost::interprocess::mapped_region mapped_region;
+    uint64_t generation;
+};
+
+#endif /* SHAREDDATALAYOUT_H_ */
@@ -21,92 +21,317 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #ifndef REQUEST_HANDLER_H
 #define REQUEST_HANDLER_H
 
-#include "APIGrammar.h"
+#include "APIDecoder.h"
 #include "BasicDatastructures.h"
+#include "ServicePool.h"
 #include "DataStructures/RouteParameters.h"
 #include "../Library/OSRM.h"
+#include "../Util/AsyncLogger.h"
+#include "../Util/QueryMetrics.h"
 #include "../Util/SimpleLogger.h"
 #include "../Util/StringUtil.h"
 #include "../typedefs.h"
 
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
 
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <string>
+#include <vector>
+
+//seconds a client is asked to wait when a service is saturated
+const static char SERVICE_RETRY_AFTER[] = "1";
 
 class RequestHandler : private boost::noncopyable {
 public:
-    typedef APIGrammar<std::string::iterator, RouteParameters> APIGrammarParser;
-    explicit RequestHandler() { }
+    typedef boost::function<void()> ReplyReadyHandler;
+    explicit RequestHandler() :
+        default_routing_machine(NULL),
+        default_compression_level(-1)
+    { }
 
-    void handle_request(const http::Request& req, http::Reply& rep){
+    //reply_ready is called once rep is complete. Services with their own
+    //pool are answered from one of its workers, others inline.
+    void handle_request(
+        const http::Request& req,
+        http::Reply& rep,
+        const ReplyReadyHandler & reply_ready
+    ){
         //parse command
         try {
-            std::string request(req.uri);
-
-            time_t ltime;
-            struct tm *Tm;
-
-            ltime=time(NULL);
-            Tm=localtime(&ltime);
-
-            SimpleLogger().Write() <<
-                (Tm->tm_mday < 10 ? "0" : "" )  << Tm->tm_mday    << "-" <<
-                (Tm->tm_mon+1 < 10 ? "0" : "" ) << (Tm->tm_mon+1) << "-" <<
-                1900+Tm->tm_year << " " << (Tm->tm_hour < 10 ? "0" : "" ) <<
-                Tm->tm_hour << ":" << (Tm->tm_min < 10 ? "0" : "" ) <<
-                Tm->tm_min << ":" << (Tm->tm_sec < 10 ? "0" : "" ) <<
-                Tm->tm_sec << " " << req.endpoint.to_string() << " " <<
-                req.referrer << ( 0 == req.referrer.length() ? "- " :" ") <<
-                req.agent << ( 0 == req.agent.length() ? "- " :" ") << req.uri;
+            AsyncLogger & async_logger = AsyncLogger::GetInstance();
+            if( async_logger.SampleAccess() ) {
+                AsyncLogLine access_line;
+                access_line << async_logger.GetTimestamp() << " " <<
+                    req.endpoint.to_string() << " " <<
+                    req.referrer << ( 0 == req.referrer.length() ? "- " :" ") <<
+                    req.agent << ( 0 == req.agent.length() ? "- " :" ") << req.uri;
+                async_logger.Write(access_line);
+            }
 
-            RouteParameters routeParameters;
-            APIGrammarParser apiParser(&routeParameters);
+            const uint64_t parse_start = QueryMetrics::GetMicroseconds();
+            //each thread decodes into its own reused parameters
+            if( !decoding_state.get() ) {
+                decoding_state.reset(new DecodingState());
+            }
+            APIDecoder & api_decoder = decoding_state->api_decoder;
+            RouteParameters & routeParameters = decoding_state->route_parameters;
+            routeParameters.Reset();
 
-            std::string::iterator it = request.begin();
-            const bool result = boost::spirit::qi::parse(
+            //the uri is parsed in place, it is not copied out of the request
+            const char * it = req.uri.begin();
+            const bool result = api_decoder.DecodeURI(
                 it,
-                request.end(),
-                apiParser
+                req.uri.end(),
+                routeParameters
             );
 
-            if ( !result || (it != request.end()) ) {
+            if ( !result || (it != req.uri.end()) ) {
                 rep = http::Reply::stockReply(http::Reply::badRequest);
-                const int position = std::distance(request.begin(), it);
+                const int position = std::distance(req.uri.begin(), it);
                 std::string tmp_position_string;
                 intToString(position, tmp_position_string);
                 rep.content += "Input seems to be malformed close to position ";
                 rep.content += "<br><pre>";
-                rep.content += request;
+                rep.content.append(req.uri.begin(), req.uri.end());
                 rep.content += tmp_position_string;
                 rep.content += "<br>";
-                const unsigned end = std::distance(request.begin(), it);
+                const unsigned end = std::distance(req.uri.begin(), it);
                 for(unsigned i = 0; i < end; ++i) {
                     rep.content += "&nbsp;";
                 }
                 rep.content += "^<br></pre>";
+            } else if ( req.post && !parse_body(req, api_decoder, routeParameters, it) ) {
+                rep = http::Reply::stockReply(http::Reply::badRequest);
+                std::string tmp_position_string;
+                intToString(std::distance(req.body.begin(), it), tmp_position_string);
+                rep.content += "Body seems to be malformed close to position ";
+                rep.content += tmp_position_string;
             } else {
+                QueryMetrics & metrics = QueryMetrics::GetInstance();
+                const unsigned service_id = metrics.GetServiceID(routeParameters.service);
+                metrics.RecordPhase(
+                    phaseParse,
+                    service_id,
+                    QueryMetrics::GetMicroseconds() - parse_start
+                );
                 //parsing done, lets call the right plugin to handle the request
-                routing_machine->RunQuery(routeParameters, rep);
-                return;
+                OSRM * routing_machine = GetRoutingMachine(routeParameters.profile);
+                std::map<std::string, boost::shared_ptr<http::ServicePool> >::iterator pool_it =
+                    service_pools.find(routeParameters.service);
+                if( NULL == routing_machine ) {
+                    rep = http::Reply::stockReply(http::Reply::badRequest);
+                    rep.content += "Unknown profile ";
+                    rep.content += routeParameters.profile;
+                } else if( service_pools.end() == pool_it ) {
+                    run_query(
+                        routing_machine,
+                        routeParameters,
+                        service_id,
+                        req.uri,
+                        rep,
+                        ReplyReadyHandler()
+                    );
+                } else if( !pool_it->second->TrySubmit(
+                        boost::bind(
+                            &RequestHandler::run_query,
+                            this,
+                            routing_machine,
+                            routeParameters,
+                            service_id,
+                            req.uri,
+                            boost::ref(rep),
+                            reply_ready
+                        )
+                    )
+                ) {
+                    rep = http::Reply::stockReply(http::Reply::serviceUnavailable);
+                    rep.setHeader("Retry-After", SERVICE_RETRY_AFTER);
+                    rep.serviceID = service_id;
+                } else {
+                    return;
+                }
             }
         } catch(std::exception& e) {
             rep = http::Reply::stockReply(http::Reply::internalServerError);
-            SimpleLogger().Write(logWARNING) <<
-                "[server error] code: " << e.what() << ", uri: " << req.uri;
-            return;
+            AsyncLogLine error_line(logWARNING);
+            error_line << "[server error] code: " << e.what() << ", uri: " << req.uri;
+            AsyncLogger::GetInstance().Write(error_line);
         }
+        reply_ready();
     };
 
-    void RegisterRoutingMachine(OSRM * osrm) {
-        routing_machine = osrm;
+    //Requests name the profile of the data set they are answered from, the
+    //first registered routing machine answers those that name none.
+    void RegisterRoutingMachine(OSRM * osrm, const std::string & profile = "") {
+        if( NULL == default_routing_machine ) {
+            default_routing_machine = osrm;
+        }
+        if( !profile.empty() ) {
+            routing_machines[profile] = osrm;
+        }
+    }
+
+    //Parses a list like "1,viaroute:6,table:9". A plain number is the level
+    //of all services that are not listed.
+    void SetCompressionLevels(const std::string & levels) {
+        std::vector<std::string> tokens;
+        boost::algorithm::split(tokens, levels, boost::algorithm::is_any_of(","));
+        BOOST_FOREACH(std::string & token, tokens) {
+            boost::algorithm::trim(token);
+            const std::string::size_type colon = token.find(':');
+            if( std::string::npos == colon ) {
+                if( !token.empty() ) {
+                    default_compression_level = ClampCompressionLevel(stringToInt(token));
+                }
+                continue;
+            }
+            const std::string service = token.substr(0, colon);
+            service_compression_levels[service] =
+                ClampCompressionLevel(stringToInt(token.substr(colon+1)));
+        }
+    }
+
+    //Parses a list like "distmatrix:2:16,viaroute:8:64", i.e. the number of
+    //worker threads and the maximum queue depth of each listed service.
+    //Services that are not listed are run by the connection threads.
+    void SetServicePools(const std::string & pools) {
+        std::vector<std::string> tokens;
+        boost::algorithm::split(tokens, pools, boost::algorithm::is_any_of(","));
+        BOOST_FOREACH(std::string & token, tokens) {
+            boost::algorithm::trim(token);
+            if( token.empty() ) {
+                continue;
+            }
+            std::vector<std::string> fields;
+            boost::algorithm::split(fields, token, boost::algorithm::is_any_of(":"));
+            if( 3 != fields.size() || 0 >= stringToInt(fields[1]) ) {
+                SimpleLogger().Write(logWARNING) << "ignoring service pool " << token;
+                continue;
+            }
+            const unsigned number_of_threads = stringToInt(fields[1]);
+            const unsigned maximum_queue_depth = std::max(0, stringToInt(fields[2]));
+            service_pools[fields[0]].reset(
+                new http::ServicePool(number_of_threads, maximum_queue_depth)
+            );
+            SimpleLogger().Write() << "service " << fields[0] << " runs on " <<
+                number_of_threads << " threads, queue depth " << maximum_queue_depth;
+        }
     }
 
 private:
-    OSRM * routing_machine;
+    //POST bodies carry further parameters, either url encoded like the query
+    //string or as packed coordinates, i.e. pairs of 32 bit little endian
+    //fixed point latitude and longitude. Fails at error_position.
+    static bool parse_body(
+        const http::Request & req,
+        APIDecoder & api_decoder,
+        RouteParameters & route_parameters,
+        const char * & error_position
+    ) {
+        const char * begin = req.body.begin();
+        const char * end = req.body.end();
+        if( req.binaryBody ) {
+            const std::size_t coordinate_size = 2*sizeof(int);
+            if( 0 != (end - begin) % coordinate_size ) {
+                error_position = end - (end - begin) % coordinate_size;
+                return false;
+            }
+            route_parameters.coordinates.reserve(
+                route_parameters.coordinates.size() + (end - begin)/coordinate_size
+            );
+            for( ; begin != end; begin += coordinate_size ) {
+                int lat, lon;
+                std::memcpy(&lat, begin, sizeof(int));
+                std::memcpy(&lon, begin + sizeof(int), sizeof(int));
+                route_parameters.coordinates.push_back(FixedPointCoordinate(lat, lon));
+            }
+            return true;
+        }
+        //tolerate the line break that tools append to uploaded files
+        while( begin != end && std::isspace(*(end-1)) ) {
+            --end;
+        }
+        if( begin == end ) {
+            return true;
+        }
+        error_position = begin;
+        return api_decoder.DecodeParameters(error_position, end, route_parameters) &&
+            (end == error_position);
+    }
+
+    //NULL if the profile is unknown
+    OSRM * GetRoutingMachine(const std::string & profile) const {
+        if( profile.empty() ) {
+            return default_routing_machine;
+        }
+        std::map<std::string, OSRM *>::const_iterator it = routing_machines.find(profile);
+        if( routing_machines.end() == it ) {
+            return NULL;
+        }
+        return it->second;
+    }
+
+    //reply_ready is empty when the query runs inline
+    void run_query(
+        OSRM * routing_machine,
+        RouteParameters & route_parameters,
+        const unsigned service_id,
+        const boost::iterator_range<const char *> & uri,
+        http::Reply & rep,
+        const ReplyReadyHandler & reply_ready
+    ) {
+        //phases deeper down are attributed to the service of the thread
+        QueryMetrics::GetInstance().SetCurrentService(service_id);
+        try {
+            routing_machine->RunQuery(route_parameters, rep);
+            rep.compressionLevel = GetCompressionLevel(route_parameters.service);
+        } catch(std::exception& e) {
+            rep = http::Reply::stockReply(http::Reply::internalServerError);
+            AsyncLogLine error_line(logWARNING);
+            error_line << "[server error] code: " << e.what() << ", uri: " << uri;
+            AsyncLogger::GetInstance().Write(error_line);
+        }
+        rep.serviceID = service_id;
+        if( reply_ready ) {
+            reply_ready();
+        }
+    }
+
+    int GetCompressionLevel(const std::string & service) const {
+        std::map<std::string, int>::const_iterator it =
+            service_compression_levels.find(service);
+        if( service_compression_levels.end() != it ) {
+            return it->second;
+        }
+        return default_compression_level;
+    }
+
+    static int ClampCompressionLevel(const int level) {
+        return std::max(0, std::min(9, level));
+    }
+
+    struct DecodingState {
+        APIDecoder api_decoder;
+        RouteParameters route_parameters;
+    };
+
+    OSRM * default_routing_machine;
+    std::map<std::string, OSRM *> routing_machines;
+    boost::thread_specific_ptr<DecodingState> decoding_state;
+    int default_compression_level;
+    std::map<std::string, int> service_compression_levels;
+    std::map<std::string, boost::shared_ptr<http::ServicePool> > service_pools;
 };
 
 #endif // REQUEST_HANDLER_H
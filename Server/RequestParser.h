@@ -23,28 +23,112 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include "BasicDatastructures.h"
 
+#include <boost/algorithm/string/find.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/logic/tribool.hpp>
+#include <boost/range/iterator_range.hpp>
 #include <boost/tuple/tuple.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+
 namespace http {
 
+//larger requests are rejected
+const static std::size_t MAX_REQUEST_HEADER_SIZE = 64 << 10;
+const static std::size_t MAX_REQUEST_BODY_SIZE = 16 << 20;
+
+/// Incremental parser for requests and their Content-Length bodies. Nothing
+/// is copied out of the receive buffer, the uri and the body of a complete
+/// request point into it. Hence all bytes of a request must be passed in one
+/// contiguous buffer; they may be moved in between calls as a whole.
+/// Requests whose length is not given by a single Content-Length, i.e. any
+/// Transfer-Encoding or a POST without it, are rejected. Otherwise their body
+/// would be taken for the next request on the connection.
 class RequestParser {
 public:
-    RequestParser() : state_(method_start) { }
-    void Reset() { state_ = method_start; }
+    RequestParser() { Reset(); }
+
+    //prepares the parser for the next request on a persistent connection
+    void Reset() {
+        state_ = method_start;
+        header.Clear();
+        method_name.clear();
+        version_major = 0;
+        version_minor = 0;
+        connection_close = false;
+        connection_keep_alive = false;
+        binary_body = false;
+        has_content_length = false;
+        has_transfer_encoding = false;
+        expect_continue = false;
+        error_status = Reply::badRequest;
+        request_length = 0;
+        uri_begin = 0;
+        uri_end = 0;
+        header_length = 0;
+        content_length = 0;
+    }
 
     boost::tuple<boost::tribool, char*> Parse(Request& req, char* begin, char* end, CompressionType * compressionType) {
         while (begin != end) {
+            if (body == state_) {
+                //the body is not inspected, just skip over what is there
+                const std::size_t available = std::min<std::size_t>(end - begin, GetMissingBodyBytes());
+                begin += available;
+                request_length += available;
+                if (0 == GetMissingBodyBytes()) {
+                    finish(req, begin);
+                    return boost::make_tuple(boost::tribool(true), begin);
+                }
+                continue;
+            }
+            ++request_length;
             boost::tribool result = consume(req, *begin++, compressionType);
-            if (result || !result){
+            if (result) {
+                if (0 < content_length) {
+                    state_ = body;
+                    continue;
+                }
+                finish(req, begin);
                 return boost::make_tuple(result, begin);
             }
+            if (!result || MAX_REQUEST_HEADER_SIZE < request_length) {
+                return boost::make_tuple(boost::tribool(false), begin);
+            }
         }
         boost::tribool result = boost::indeterminate;
         return boost::make_tuple(result, begin);
     }
 
+    //the status to answer a request with that Parse() rejected
+    Reply::status_type GetErrorStatus() const {
+        return error_status;
+    }
+
+    //true while the body of a request with "Expect: 100-continue" is awaited
+    bool ExpectsContinue() const {
+        return body == state_ && expect_continue;
+    }
+
+    //bytes of the announced body that were not passed to Parse() yet
+    std::size_t GetMissingBodyBytes() const {
+        if (body != state_) {
+            return 0;
+        }
+        return header_length + content_length - request_length;
+    }
+
 private:
+    //end is the first byte after the request
+    void finish(Request& req, const char * end) {
+        const char * request_begin = end - request_length;
+        req.uri = boost::make_iterator_range(request_begin + uri_begin, request_begin + uri_end);
+        req.body = boost::make_iterator_range(request_begin + header_length, end);
+        req.post = ("POST" == method_name);
+        req.binaryBody = binary_body;
+    }
+
     boost::tribool consume(Request& req, char input, CompressionType * compressionType) {
         switch (state_) {
         case method_start:
@@ -52,15 +136,19 @@ private:
                 return false;
             } else {
                 state_ = method;
+                method_name.push_back(input);
                 return boost::indeterminate;
             }
         case method:
             if (input == ' ') {
                 state_ = uri;
+                uri_begin = request_length;
+                uri_end = request_length;
                 return boost::indeterminate;
             } else if (!isChar(input) || isCTL(input) || isTSpecial(input)) {
                 return false;
             } else {
+                method_name.push_back(input);
                 return boost::indeterminate;
             }
         case uri_start:
@@ -68,7 +156,8 @@ private:
                 return false;
             } else {
                 state_ = uri;
-                req.uri.push_back(input);
+                uri_begin = request_length - 1;
+                uri_end = request_length;
                 return boost::indeterminate;
             }
         case uri:
@@ -78,7 +167,7 @@ private:
             } else if (isCTL(input)) {
                 return false;
             } else {
-                req.uri.push_back(input);
+                uri_end = request_length;
                 return boost::indeterminate;
             }
         case http_version_h:
@@ -118,6 +207,7 @@ private:
             }
         case http_version_major_start:
             if (isDigit(input)) {
+                version_major = input - '0';
                 state_ = http_version_major;
                 return boost::indeterminate;
             } else {
@@ -128,12 +218,14 @@ private:
                 state_ = http_version_minor_start;
                 return boost::indeterminate;
             } else if (isDigit(input)) {
+                version_major = 10*version_major + (input - '0');
                 return boost::indeterminate;
             } else {
                 return false;
             }
         case http_version_minor_start:
             if (isDigit(input)) {
+                version_minor = input - '0';
                 state_ = http_version_minor;
                 return boost::indeterminate;
             } else {
@@ -144,6 +236,7 @@ private:
                 state_ = expecting_newline_1;
                 return boost::indeterminate;
             } else if (isDigit(input)) {
+                version_minor = 10*version_minor + (input - '0');
                 return boost::indeterminate;
             }
             else {
@@ -171,6 +264,34 @@ private:
             if("User-Agent" == header.name)
                 req.agent = header.value;
 
+            if(boost::algorithm::iequals(header.name, "Connection")) {
+                if(boost::algorithm::ifind_first(header.value, "close"))
+                    connection_close = true;
+                if(boost::algorithm::ifind_first(header.value, "keep-alive"))
+                    connection_keep_alive = true;
+            }
+
+            if(boost::algorithm::iequals(header.name, "Content-Length")) {
+                //a second length might be the one a proxy in front went by
+                if(has_content_length || !parseContentLength(header.value))
+                    return false;
+                has_content_length = true;
+            }
+
+            if(boost::algorithm::iequals(header.name, "Transfer-Encoding"))
+                has_transfer_encoding = true;
+
+            if(boost::algorithm::iequals(header.name, "Expect")) {
+                if(boost::algorithm::ifind_first(header.value, "100-continue"))
+                    expect_continue = true;
+            }
+
+            //a body of packed coordinates instead of url encoded parameters
+            if(boost::algorithm::iequals(header.name, "Content-Type")) {
+                binary_body = boost::algorithm::istarts_with(header.value, "application/octet-stream");
+            }
+            header.Clear();
+
             if (input == '\r') {
                 state_ = expecting_newline_3;
                 return boost::indeterminate;
@@ -230,12 +351,45 @@ private:
                 return false;
             }
         case expecting_newline_3:
-            return (input == '\n');
+            if (input != '\n') {
+                return false;
+            }
+            //HTTP/1.1 connections persist unless closed, HTTP/1.0 ones on request
+            if (1 < version_major || (1 == version_major && 1 <= version_minor)) {
+                req.keepAlive = !connection_close;
+                req.acceptsChunked = true;
+            } else {
+                req.keepAlive = connection_keep_alive && !connection_close;
+                expect_continue = false;
+            }
+            if (has_transfer_encoding) {
+                error_status = Reply::notImplemented;
+                return false;
+            }
+            if ("POST" == method_name && !has_content_length) {
+                error_status = Reply::lengthRequired;
+                return false;
+            }
+            header_length = request_length;
+            return true;
         default:
             return false;
         }
     }
 
+    inline bool parseContentLength(const std::string & value) {
+        if (value.empty() || value.size() > 9 ||
+            value.end() != std::find_if(value.begin(), value.end(), isNoDigit)) {
+            return false;
+        }
+        content_length = std::atoi(value.c_str());
+        return content_length <= MAX_REQUEST_BODY_SIZE;
+    }
+
+    static inline bool isNoDigit(char c) {
+        return c < '0' || c > '9';
+    }
+
     inline bool isChar(int c) {
         return c >= 0 && c <= 127;
     }
@@ -281,10 +435,27 @@ private:
         space_before_header_value,
         header_value,
         expecting_newline_2,
-        expecting_newline_3
+        expecting_newline_3,
+        body
     } state_;
 
     Header header;
+    std::string method_name;
+    unsigned version_major;
+    unsigned version_minor;
+    bool connection_close;
+    bool connection_keep_alive;
+    bool binary_body;
+    bool has_content_length;
+    bool has_transfer_encoding;
+    bool expect_continue;
+    Reply::status_type error_status;
+    //offsets from the start of the request
+    std::size_t request_length;
+    std::size_t uri_begin;
+    std::size_t uri_end;
+    std::size_t header_length;
+    std::size_t content_length;
 };
 
 } // namespace http
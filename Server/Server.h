@@ -23,6 +23,9 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include "Connection.h"
 #include "RequestHandler.h"
+#include "../Util/MemoryPlacement.h"
+#include "../Util/OSRMException.h"
+#include "../Util/SimpleLogger.h"
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -30,42 +33,156 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <vector>
 
+//where Run() binds the worker threads
+enum ThreadPinning {
+	pinNone = 0,
+	pinToCore = 1,
+	pinToNUMANode = 2
+};
+
+#ifdef SO_REUSEPORT
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
+/// Accepts connections and runs the worker threads. By default all threads
+/// share one io_service and one acceptor. With io_service_per_thread every
+/// thread gets its own io_service and its own acceptor on the same port
+/// (SO_REUSEPORT), the kernel spreads incoming connections over them and a
+/// connection is handled by the same thread from accept to the last write.
 class Server: private boost::noncopyable {
 public:
 	explicit Server(
 		const std::string& address,
 		const std::string& port,
-		unsigned thread_pool_size
+		unsigned thread_pool_size,
+		unsigned keep_alive_timeout,
+		bool io_service_per_thread = false,
+		ThreadPinning thread_pinning = pinNone
 	) :
 		threadPoolSize(thread_pool_size),
-		acceptor(ioService),
-		newConnection(new http::Connection(ioService, requestHandler)),
+		keepAliveTimeout(keep_alive_timeout),
+		threadPinning(thread_pinning),
+		nextLocalService(0),
 		requestHandler()
 	{
-		boost::asio::ip::tcp::resolver resolver(ioService);
+#ifndef SO_REUSEPORT
+		if(io_service_per_thread) {
+			SimpleLogger().Write(logWARNING) <<
+				"SO_REUSEPORT not supported, all threads share one io_service";
+			io_service_per_thread = false;
+		}
+#endif
+		const unsigned number_of_services = (io_service_per_thread ? threadPoolSize : 1);
+		//hint at the number of threads that run each io_service
+		const unsigned threads_per_service = threadPoolSize/number_of_services;
+		for(unsigned i = 0; i < number_of_services; ++i) {
+			ioServices.push_back(
+				boost::shared_ptr<boost::asio::io_service>(
+					new boost::asio::io_service(threads_per_service)
+				)
+			);
+			acceptors.push_back(
+				boost::shared_ptr<boost::asio::ip::tcp::acceptor>(
+					new boost::asio::ip::tcp::acceptor(*ioServices.back())
+				)
+			);
+			newConnections.push_back(boost::shared_ptr<http::Connection>());
+		}
+
+		boost::asio::ip::tcp::resolver resolver(*ioServices[0]);
 		boost::asio::ip::tcp::resolver::query query(address, port);
 		boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(query);
 
-		acceptor.open(endpoint.protocol());
-		acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-		acceptor.bind(endpoint);
-		acceptor.listen();
-		acceptor.async_accept(
-			newConnection->socket(),
-			boost::bind(
-				&Server::handleAccept,
-				this,
-				boost::asio::placeholders::error
-			)
-		);
+		for(unsigned i = 0; i < acceptors.size(); ++i) {
+			boost::asio::ip::tcp::acceptor & acceptor = *acceptors[i];
+			acceptor.open(endpoint.protocol());
+			acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+			if(io_service_per_thread) {
+				acceptor.set_option(reuse_port(true));
+			}
+#endif
+			acceptor.bind(endpoint);
+			acceptor.listen();
+			startAccept(i);
+		}
+	}
+
+	/// Additionally accepts co-located clients on a Unix domain socket. A
+	/// stale socket file of a previous run is replaced, one that a process
+	/// still listens on is not. Connections are spread round robin over the
+	/// io_services.
+	void AddLocalListener(const std::string & path, const unsigned permissions) {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+		const boost::asio::local::stream_protocol::endpoint endpoint(path);
+		struct stat file_status;
+		if (0 == ::lstat(path.c_str(), &file_status)) {
+			if (!S_ISSOCK(file_status.st_mode)) {
+				throw OSRMException("unix socket path exists and is no socket: " + path);
+			}
+			//only a socket nobody listens on refuses the connection
+			boost::asio::local::stream_protocol::socket probe(*ioServices[0]);
+			boost::system::error_code probe_error;
+			probe.connect(endpoint, probe_error);
+			if (boost::asio::error::connection_refused != probe_error) {
+				throw OSRMException("unix socket is in use by another process: " + path);
+			}
+			::unlink(path.c_str());
+		}
+		localAcceptor.reset(new boost::asio::local::stream_protocol::acceptor(*ioServices[0]));
+		localAcceptor->open();
+		localAcceptor->bind(endpoint);
+		if (0 != ::chmod(path.c_str(), permissions) || 0 != ::lstat(path.c_str(), &file_status)) {
+			throw OSRMException("could not set permissions of unix socket " + path);
+		}
+		localAcceptor->listen();
+		localSocketPath = path;
+		localSocketDevice = file_status.st_dev;
+		localSocketInode = file_status.st_ino;
+		startLocalAccept();
+		SimpleLogger().Write() << "listening on unix socket " << path;
+#else
+		SimpleLogger().Write(logWARNING) <<
+			"unix domain sockets not supported, not listening on " << path;
+#endif
+	}
+
+	/// Removes the socket file unless another process replaced it meanwhile
+	~Server() {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+		struct stat file_status;
+		if (
+			!localSocketPath.empty() &&
+			0 == ::lstat(localSocketPath.c_str(), &file_status) &&
+			localSocketDevice == file_status.st_dev &&
+			localSocketInode == file_status.st_ino
+		) {
+			::unlink(localSocketPath.c_str());
+		}
+#endif
 	}
 
 	void Run() {
 		std::vector<boost::shared_ptr<boost::thread> > threads;
 		for (unsigned i = 0; i < threadPoolSize; ++i) {
-			boost::shared_ptr<boost::thread> thread(new boost::thread(boost::bind(&boost::asio::io_service::run, &ioService)));
+			boost::asio::io_service & io_service = *ioServices[i % ioServices.size()];
+			boost::shared_ptr<boost::thread> thread(new boost::thread(boost::bind(&boost::asio::io_service::run, &io_service)));
+			if(pinNone != threadPinning) {
+				pinThread(*thread, i, threadPinning);
+			}
 			threads.push_back(thread);
 		}
 		for (unsigned i = 0; i < threads.size(); ++i)
@@ -73,7 +190,8 @@ public:
 	}
 
 	void Stop() {
-		ioService.stop();
+		for (unsigned i = 0; i < ioServices.size(); ++i)
+			ioServices[i]->stop();
 	}
 
 	RequestHandler & GetRequestHandlerPtr() {
@@ -81,27 +199,89 @@ public:
 	}
 
 private:
-	void handleAccept(const boost::system::error_code& e) {
+	void startAccept(const unsigned listener) {
+		newConnections[listener].reset(
+			new http::Connection(*ioServices[listener], requestHandler, replyBufferPool, compressionBufferPool, keepAliveTimeout)
+		);
+		acceptors[listener]->async_accept(
+			newConnections[listener]->socket(),
+			boost::bind(
+				&Server::handleAccept,
+				this,
+				listener,
+				boost::asio::placeholders::error
+			)
+		);
+	}
+
+	void handleAccept(const unsigned listener, const boost::system::error_code& e) {
 		if (!e) {
-			newConnection->start();
-			newConnection.reset(
-				new http::Connection(ioService, requestHandler)
-			);
-			acceptor.async_accept(
-				newConnection->socket(),
-				boost::bind(
-					&Server::handleAccept,
-					this,
-					boost::asio::placeholders::error
-				)
-			);
+			newConnections[listener]->start();
+			startAccept(listener);
+		}
+	}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	void startLocalAccept() {
+		boost::asio::io_service & io_service = *ioServices[nextLocalService];
+		nextLocalService = (nextLocalService + 1) % ioServices.size();
+		newLocalConnection.reset(
+			new http::LocalConnection(io_service, requestHandler, replyBufferPool, compressionBufferPool, keepAliveTimeout)
+		);
+		localAcceptor->async_accept(
+			newLocalConnection->socket(),
+			boost::bind(
+				&Server::handleLocalAccept,
+				this,
+				boost::asio::placeholders::error
+			)
+		);
+	}
+
+	void handleLocalAccept(const boost::system::error_code& e) {
+		if (!e) {
+			newLocalConnection->start();
+			startLocalAccept();
+		}
+	}
+#endif
+
+	//binds thread i to core i or to the cpus of NUMA node i, threads beyond
+	//the number of cores or nodes wrap around
+	static void pinThread(boost::thread & thread, const unsigned i, const ThreadPinning pinning) {
+#ifdef __linux__
+		std::vector<unsigned> cpus;
+		if(pinToNUMANode == pinning) {
+			const std::vector<NUMANode> nodes = GetNUMANodes();
+			cpus = nodes[i % nodes.size()].cpus;
+		} else {
+			cpus.push_back(i % std::max(1u, boost::thread::hardware_concurrency()));
+		}
+		if(!BindThreadToCPUs(thread.native_handle(), cpus)) {
+			SimpleLogger().Write(logWARNING) << "could not pin thread " << i;
 		}
+#else
+		SimpleLogger().Write(logWARNING) << "thread pinning not supported on this platform";
+#endif
 	}
 
 	unsigned threadPoolSize;
-	boost::asio::io_service ioService;
-	boost::asio::ip::tcp::acceptor acceptor;
-	boost::shared_ptr<http::Connection> newConnection;
+	unsigned keepAliveTimeout;
+	ThreadPinning threadPinning;
+	// pools outlive the io_services, which destroy the last connections
+	http::BufferPool<std::string> replyBufferPool;
+	http::BufferPool<std::vector<unsigned char> > compressionBufferPool;
+	std::vector<boost::shared_ptr<boost::asio::io_service> > ioServices;
+	std::vector<boost::shared_ptr<boost::asio::ip::tcp::acceptor> > acceptors;
+	std::vector<boost::shared_ptr<http::Connection> > newConnections;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	boost::shared_ptr<boost::asio::local::stream_protocol::acceptor> localAcceptor;
+	boost::shared_ptr<http::LocalConnection> newLocalConnection;
+	dev_t localSocketDevice;
+	ino_t localSocketInode;
+#endif
+	std::string localSocketPath;
+	unsigned nextLocalService;
 	RequestHandler requestHandler;
 };
 
@@ -22,6 +22,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #define SERVERFACTORY_H_
 
 #include "Server.h"
+#include "../Util/AsyncLogger.h"
 #include "../Util/IniFile.h"
 #include "../Util/SimpleLogger.h"
 #include "../Util/StringUtil.h"
@@ -30,6 +31,8 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include <boost/noncopyable.hpp>
 
+#include <cstdlib>
+
 struct ServerFactory : boost::noncopyable {
 	static Server * CreateServer( IniFile & serverConfig ) {
 		int threads = omp_get_num_procs();
@@ -48,14 +51,75 @@ struct ServerFactory : boost::noncopyable {
 			threads = stringToInt( serverConfig.GetParameter("Threads") );
 		}
 
+		//seconds an idle persistent connection is kept open, 0 disables keep-alive
+		int keep_alive_timeout = 5;
+		if( !serverConfig.GetParameter("KeepAliveTimeout").empty() ) {
+			keep_alive_timeout = std::max(
+				0,
+				stringToInt(serverConfig.GetParameter("KeepAliveTimeout"))
+			);
+		}
+
+		//one io_service and acceptor per thread instead of a shared one
+		const bool io_service_per_thread =
+			( 0 != stringToInt(serverConfig.GetParameter("IOServicePerThread")) );
+		//"1" pins each thread to a core, "numa" to the cpus of a NUMA node
+		ThreadPinning thread_pinning = pinNone;
+		if( "numa" == serverConfig.GetParameter("PinThreads") ) {
+			thread_pinning = pinToNUMANode;
+		} else if( 0 != stringToInt(serverConfig.GetParameter("PinThreads")) ) {
+			thread_pinning = pinToCore;
+		}
+
+		//request threads hand their log lines to a background writer
+		LogLevel log_level = logINFO;
+		if( "warning" == serverConfig.GetParameter("LogLevel") ) {
+			log_level = logWARNING;
+		} else if( "debug" == serverConfig.GetParameter("LogLevel") ) {
+			log_level = logDEBUG;
+		}
+		//every n-th request is logged, 0 turns the access log off
+		int access_log_sample_rate = 1;
+		if( !serverConfig.GetParameter("AccessLogSampleRate").empty() ) {
+			access_log_sample_rate = std::max(
+				0,
+				stringToInt(serverConfig.GetParameter("AccessLogSampleRate"))
+			);
+		}
+		AsyncLogger::GetInstance().Start(log_level, access_log_sample_rate);
+
 		SimpleLogger().Write() <<
 			"http 1.1 compression handled by zlib version " << zlibVersion();
 
 		Server * server = new Server(
 			serverConfig.GetParameter("IP"),
 			serverConfig.GetParameter("Port"),
-			threads
+			threads,
+			keep_alive_timeout,
+			io_service_per_thread,
+			thread_pinning
+		);
+		//e.g. "1,viaroute:6,table:9", unset levels use the encoding's default
+		server->GetRequestHandlerPtr().SetCompressionLevels(
+			serverConfig.GetParameter("CompressionLevel")
 		);
+		//e.g. "distmatrix:2:16", separate workers and queue depth per service
+		server->GetRequestHandlerPtr().SetServicePools(
+			serverConfig.GetParameter("ServicePools")
+		);
+		//local clients may connect through a unix domain socket, too
+		if( !serverConfig.GetParameter("UnixSocket").empty() ) {
+			unsigned permissions = 0660;
+			if( !serverConfig.GetParameter("UnixSocketPermissions").empty() ) {
+				permissions = std::strtoul(
+					serverConfig.GetParameter("UnixSocketPermissions").c_str(), 0, 8
+				);
+			}
+			server->AddLocalListener(
+				serverConfig.GetParameter("UnixSocket"),
+				permissions
+			);
+		}
 		return server;
 	}
 
@@ -0,0 +1,105 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef SERVICE_POOL_H
+#define SERVICE_POOL_H
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+
+namespace http {
+
+/// Runs the queries of one service on its own worker threads, so that
+/// expensive services cannot occupy all connection threads. Once all workers
+/// are busy at most maximum_queue_depth jobs wait, further jobs are refused.
+class ServicePool : private boost::noncopyable {
+public:
+	typedef boost::function<void()> Job;
+
+	ServicePool(const unsigned number_of_threads, const unsigned maximum_queue_depth) :
+		maximumQueueDepth(maximum_queue_depth),
+		idleWorkers(0),
+		stopped(false)
+	{
+		for (unsigned i = 0; i < number_of_threads; ++i) {
+			workers.create_thread(boost::bind(&ServicePool::work, this));
+		}
+	}
+
+	/// Jobs that did not start yet are dropped
+	~ServicePool() {
+		{
+			boost::mutex::scoped_lock lock(queueMutex);
+			stopped = true;
+		}
+		jobAvailable.notify_all();
+		workers.join_all();
+	}
+
+	/// Returns false without running the job if the queue is full
+	bool TrySubmit(const Job & job) {
+		{
+			boost::mutex::scoped_lock lock(queueMutex);
+			if (stopped || idleWorkers + maximumQueueDepth <= pendingJobs.size()) {
+				return false;
+			}
+			pendingJobs.push_back(job);
+		}
+		jobAvailable.notify_one();
+		return true;
+	}
+
+private:
+	void work() {
+		for (;;) {
+			Job job;
+			{
+				boost::mutex::scoped_lock lock(queueMutex);
+				++idleWorkers;
+				while (!stopped && pendingJobs.empty()) {
+					jobAvailable.wait(lock);
+				}
+				--idleWorkers;
+				if (stopped) {
+					return;
+				}
+				job.swap(pendingJobs.front());
+				pendingJobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	const std::size_t maximumQueueDepth;
+	std::size_t idleWorkers;
+	bool stopped;
+	boost::mutex queueMutex;
+	boost::condition_variable jobAvailable;
+	std::deque<Job> pendingJobs;
+	boost::thread_group workers;
+};
+
+} // namespace http
+
+#endif // SERVICE_POOL_H
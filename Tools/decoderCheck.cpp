@@ -0,0 +1,252 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+
+// Checks that APIDecoder accepts exactly what APIGrammar accepts on random,
+// partly mangled requests, and compares what both cost per request.
+
+#include "../Server/APIDecoder.h"
+#include "../Server/APIGrammar.h"
+#include "../Server/DataStructures/RouteParameters.h"
+#include "../Util/SimpleLogger.h"
+#include "../Util/TimingUtil.h"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+//counts heap allocations to show that decoding does none
+static unsigned long long number_of_allocations = 0;
+
+void * operator new(std::size_t size) {
+    ++number_of_allocations;
+    void * pointer = std::malloc(size ? size : 1);
+    if( !pointer ) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void * pointer) {
+    std::free(pointer);
+}
+
+typedef APIGrammar<const char *, RouteParameters> APIGrammarParser;
+
+static unsigned Random(const unsigned range) {
+    return std::rand() % range;
+}
+
+template<unsigned N>
+static std::string Pick(const char * const (&choices)[N]) {
+    return choices[Random(N)];
+}
+
+static std::string RandomValue() {
+    const char * const values[] = {
+        "0", "1", "14", "-3", "+7", "18", "32767", "32768", "-32769",
+        "2147483647", "2147483648", "-2147483648", "4294967295",
+        "52.519930", "13.438640", "-0.5", ".5", "5.", "1e3", "1E-2", "1e",
+        "nan", "inf", "-infinity", "NaN", "0x10",
+        "true", "false", "True", "1true", "truex",
+        "json", "gpx", "de", "cb_1.x-y", "abc123", "_", "-", ".",
+        "", "%20", "a b", "52.5,13.4", "52.5,", ",13.4", "1,2,3", "90,30", "360,10"
+    };
+    std::string value = Pick(values);
+    if( 0 == Random(3) ) {
+        value += "," + Pick(values);
+    }
+    return value;
+}
+
+static std::string RandomParameter() {
+    const char * const keys[] = {
+        "z", "output", "jsonp", "checksum", "loc", "hint", "b", "compression",
+        "hl", "instructions", "geometry", "alt", "geomformat", "profile",
+        "zz", "lo", "locx", "hin", "geom", "Z", "LOC", ""
+    };
+    const char * const separators[] = { "&", "&", "&", "", "&&", "?", "=" };
+    std::string parameter = Pick(separators) + Pick(keys);
+    if( 0 != Random(10) ) {
+        parameter += "=";
+    }
+    return parameter + RandomValue();
+}
+
+static std::string RandomRequest() {
+    const char * const services[] = {
+        "/viaroute", "/nearest", "/locate", "/table", "/timestamp", "/hello",
+        "/", "viaroute", "/via1", "//", "/Distmatrix",
+        "/car/viaroute", "/foot/table", "/car/", "/car//viaroute", "/car1/nearest"
+    };
+    std::string request = Pick(services);
+    const unsigned number_of_queries = Random(3);
+    for( unsigned i = 0; i < number_of_queries; ++i ) {
+        request += "?";
+        const unsigned number_of_parameters = Random(6);
+        for( unsigned j = 0; j < number_of_parameters; ++j ) {
+            request += RandomParameter();
+        }
+    }
+    //flip, drop or duplicate a few characters
+    const char alphabet[] = "/?&=,.-_+azZ09eE \t%";
+    const unsigned number_of_mutations = Random(4) ? 0 : Random(3) + 1;
+    for( unsigned i = 0; i < number_of_mutations && !request.empty(); ++i ) {
+        const unsigned position = Random(request.size());
+        switch( Random(3) ) {
+        case 0:
+            request[position] = alphabet[Random(sizeof(alphabet)-1)];
+            break;
+        case 1:
+            request.erase(position, 1);
+            break;
+        default:
+            request.insert(position, 1, request[position]);
+            break;
+        }
+    }
+    return request;
+}
+
+static bool operator==(const BearingFilter & a, const BearingFilter & b) {
+    return a.bearing == b.bearing && a.range == b.range;
+}
+
+static bool operator==(const RouteParameters & a, const RouteParameters & b) {
+    return
+        a.zoomLevel == b.zoomLevel &&
+        a.printInstructions == b.printInstructions &&
+        a.alternateRoute == b.alternateRoute &&
+        a.geometry == b.geometry &&
+        a.compression == b.compression &&
+        a.deprecatedAPI == b.deprecatedAPI &&
+        a.checkSum == b.checkSum &&
+        a.service == b.service &&
+        a.profile == b.profile &&
+        a.outputFormat == b.outputFormat &&
+        a.jsonpParameter == b.jsonpParameter &&
+        a.language == b.language &&
+        a.hints == b.hints &&
+        a.bearings == b.bearings &&
+        a.coordinates == b.coordinates;
+}
+
+static bool IsEquivalent(const std::string & request, APIDecoder & api_decoder, RouteParameters & decoded_parameters) {
+    const char * begin = request.c_str();
+    const char * end = begin + request.size();
+
+    RouteParameters parsed_parameters;
+    APIGrammarParser api_parser(&parsed_parameters);
+    const char * parsed_end = begin;
+    const bool parsed = boost::spirit::qi::parse(parsed_end, end, api_parser);
+
+    decoded_parameters.Reset();
+    const char * decoded_end = begin;
+    const bool decoded = api_decoder.DecodeURI(decoded_end, end, decoded_parameters);
+
+    //a POST body is parsed from the start of the parameter list
+    const char * body = std::min(end, begin + request.find('?') + 1);
+    RouteParameters parsed_body_parameters;
+    APIGrammarParser body_parser(&parsed_body_parameters);
+    const char * parsed_body_end = body;
+    const bool parsed_body = boost::spirit::qi::parse(parsed_body_end, end, body_parser.parameters);
+    RouteParameters decoded_body_parameters;
+    const char * decoded_body_end = body;
+    const bool decoded_body = api_decoder.DecodeParameters(decoded_body_end, end, decoded_body_parameters);
+
+    //parameters of failed parses are thrown away, they need not be equal
+    return
+        parsed == decoded && parsed_end == decoded_end &&
+        ( !parsed || parsed_parameters == decoded_parameters ) &&
+        parsed_body == decoded_body && parsed_body_end == decoded_body_end &&
+        ( !parsed_body || parsed_body_parameters == decoded_body_parameters );
+}
+
+int main (int argc, char * argv[]) {
+    LogPolicy::GetInstance().Unmute();
+    const unsigned number_of_requests = ( argc > 1 ? std::atoi(argv[1]) : 1000000 );
+
+    APIDecoder api_decoder;
+    RouteParameters route_parameters;
+    unsigned number_of_accepted_requests = 0;
+    for( unsigned i = 0; i < number_of_requests; ++i ) {
+        const std::string request = RandomRequest();
+        if( !IsEquivalent(request, api_decoder, route_parameters) ) {
+            SimpleLogger().Write(logWARNING) << "decoder differs from grammar on " << request;
+            return -1;
+        }
+        const char * end = request.c_str();
+        if(
+            api_decoder.DecodeURI(end, request.c_str() + request.size(), route_parameters) &&
+            request.c_str() + request.size() == end
+        ) {
+            ++number_of_accepted_requests;
+        }
+    }
+    SimpleLogger().Write() << number_of_requests << " random requests decoded like the grammar does, " <<
+        number_of_accepted_requests << " of them valid";
+
+    std::vector<std::string> requests;
+    requests.push_back("/locate?loc=52.519930,13.438640");
+    requests.push_back("/viaroute?loc=52.519930,13.438640&loc=52.513191,13.415852&z=14&output=json&instructions=true&alt=false");
+    requests.push_back("/viaroute?loc=52.519930,13.438640&hint=xy8AAABqPQAAAAAAAAQAAACDjTEAAQAAAM2j8QAAAAAAANwyAAA-ABAA&loc=52.513191,13.415852&hint=mR0AABA_AQAAAAAABgAAAAIAAAB5iTEAAQAAANa-8QAAAAAAAAAAAAA-ABAA&checksum=1712847");
+    std::string table("/table?z=18");
+    for( unsigned i = 0; i < 25; ++i ) {
+        table += "&loc=52.5" + std::string(1, char('0'+i%10)) + "9930,13.4" + std::string(1, char('0'+i/3%10)) + "8640";
+    }
+    requests.push_back(table);
+
+    const unsigned number_of_iterations = 100000;
+    for( unsigned r = 0; r < requests.size(); ++r ) {
+        const std::string & request = requests[r];
+        const char * end = request.c_str() + request.size();
+
+        //what the handler did before: copy the uri, build the grammar, parse
+        unsigned long long allocations = number_of_allocations;
+        double time_stamp = get_timestamp();
+        for( unsigned i = 0; i < number_of_iterations; ++i ) {
+            std::string uri(request);
+            RouteParameters parameters;
+            APIGrammar<std::string::iterator, RouteParameters> api_parser(&parameters);
+            std::string::iterator it = uri.begin();
+            boost::spirit::qi::parse(it, uri.end(), api_parser);
+        }
+        const double grammar_time = get_timestamp() - time_stamp;
+        const double grammar_allocations = double(number_of_allocations - allocations)/number_of_iterations;
+
+        allocations = number_of_allocations;
+        time_stamp = get_timestamp();
+        for( unsigned i = 0; i < number_of_iterations; ++i ) {
+            route_parameters.Reset();
+            const char * it = request.c_str();
+            api_decoder.DecodeURI(it, end, route_parameters);
+        }
+        const double decoder_time = get_timestamp() - time_stamp;
+        const double decoder_allocations = double(number_of_allocations - allocations)/number_of_iterations;
+
+        SimpleLogger().Write() << request.size() << " byte request: grammar " <<
+            1e9*grammar_time/number_of_iterations << " ns, " << grammar_allocations <<
+            " allocations; decoder " <<
+            1e9*decoder_time/number_of_iterations << " ns, " << decoder_allocations <<
+            " allocations";
+    }
+    return 0;
+}
@@ -0,0 +1,309 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef ASYNC_LOGGER_H_
+#define ASYNC_LOGGER_H_
+
+#include "SimpleLogger.h"
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//a line takes a fixed slot in the ring, longer lines are cut off
+const static unsigned ASYNC_LOG_LINE_SIZE = 512;
+const static unsigned ASYNC_LOG_RING_SIZE = 1024;
+const static unsigned ASYNC_LOG_IDLE_WAIT_MS = 5;
+
+//debug < info < warning
+inline unsigned GetLogSeverity(const LogLevel level) {
+    switch(level) {
+    case logDEBUG:
+        return 0;
+    case logINFO:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+// Log line that is formatted on the stack, without allocations
+class AsyncLogLine {
+public:
+    explicit AsyncLogLine(const LogLevel l = logINFO) : level(l), length(0) { }
+
+    AsyncLogLine & operator<<(const char * text) {
+        return Append(text, std::strlen(text));
+    }
+
+    AsyncLogLine & operator<<(const std::string & text) {
+        return Append(text.c_str(), text.length());
+    }
+
+    AsyncLogLine & operator<<(const boost::iterator_range<const char *> & text) {
+        return Append(text.begin(), text.size());
+    }
+
+    AsyncLogLine & operator<<(const unsigned number) {
+        char digits[16];
+        const int number_of_digits = std::sprintf(digits, "%u", number);
+        return Append(digits, number_of_digits);
+    }
+
+    AsyncLogLine & Append(const char * text, const std::size_t text_length) {
+        const std::size_t copied_length = std::min<std::size_t>(
+            text_length,
+            ASYNC_LOG_LINE_SIZE - length
+        );
+        std::memcpy(buffer + length, text, copied_length);
+        length += copied_length;
+        return *this;
+    }
+
+    LogLevel level;
+    unsigned length;
+    char buffer[ASYNC_LOG_LINE_SIZE];
+};
+
+// Hands log lines of request threads to a background thread that writes
+// them out. Every thread owns a lock-free single producer ring, so logging
+// neither locks nor waits for the console. When a ring is full the line is
+// dropped and counted, the number of dropped lines is logged later on.
+// Until Start() is called lines are written synchronously.
+class AsyncLogger : boost::noncopyable {
+public:
+    static AsyncLogger & GetInstance() {
+        static AsyncLogger runningInstance;
+        return runningInstance;
+    }
+
+    //lines less severe than level are discarded. Only every sample_rate-th
+    //access of a thread is logged, 0 turns access logging off.
+    void Start(const LogLevel level, const unsigned sample_rate) {
+        minimum_severity = GetLogSeverity(level);
+        access_sample_rate = sample_rate;
+        if( !drain_thread ) {
+            is_running = true;
+            drain_thread.reset(
+                new boost::thread(boost::bind(&AsyncLogger::Drain, this))
+            );
+        }
+    }
+
+    //writes out all pending lines
+    void Stop() {
+        if( drain_thread ) {
+            is_running = false;
+            drain_thread->join();
+            drain_thread.reset();
+        }
+    }
+
+    bool IsEnabled(const LogLevel level) const {
+        return minimum_severity <= GetLogSeverity(level);
+    }
+
+    //true for every sample_rate-th access of the calling thread
+    bool SampleAccess() {
+        if( 0 == access_sample_rate || !IsEnabled(logINFO) ) {
+            return false;
+        }
+        ThreadLog & thread_log = GetThreadLog();
+        if( ++thread_log.access_count < access_sample_rate ) {
+            return false;
+        }
+        thread_log.access_count = 0;
+        return true;
+    }
+
+    //local time, formatted once per second and thread
+    const char * GetTimestamp() {
+        ThreadLog & thread_log = GetThreadLog();
+        const time_t now = time(NULL);
+        if( now != thread_log.timestamp_second ) {
+            struct tm local_time;
+#ifdef _WIN32
+            localtime_s(&local_time, &now);
+#else
+            localtime_r(&now, &local_time);
+#endif
+            std::strftime(
+                thread_log.timestamp,
+                sizeof(thread_log.timestamp),
+                "%d-%m-%Y %H:%M:%S",
+                &local_time
+            );
+            thread_log.timestamp_second = now;
+        }
+        return thread_log.timestamp;
+    }
+
+    void Write(const AsyncLogLine & line) {
+        if( !IsEnabled(line.level) ) {
+            return;
+        }
+        if( !drain_thread ) {
+            boost::mutex::scoped_lock lock(sink_mutex);
+            Print(line);
+            return;
+        }
+        ThreadLog & thread_log = GetThreadLog();
+        if( !thread_log.ring.push(line) ) {
+            ++thread_log.number_of_dropped_lines;
+        }
+    }
+
+private:
+    typedef boost::lockfree::spsc_queue<
+        AsyncLogLine,
+        boost::lockfree::capacity<ASYNC_LOG_RING_SIZE>
+    > LogRing;
+
+    struct ThreadLog : boost::noncopyable {
+        ThreadLog() :
+            access_count(0),
+            timestamp_second(-1),
+            number_of_dropped_lines(0),
+            number_of_reported_drops(0)
+        {
+            timestamp[0] = '\0';
+        }
+        LogRing ring;
+        unsigned access_count;
+        time_t timestamp_second;
+        char timestamp[20];
+        boost::atomic<unsigned> number_of_dropped_lines;
+        //only touched by the drain thread
+        unsigned number_of_reported_drops;
+    };
+
+    AsyncLogger() :
+        current_thread_log(&AsyncLogger::KeepThreadLog),
+        minimum_severity(GetLogSeverity(logINFO)),
+        access_sample_rate(1),
+        is_running(false)
+    { }
+
+    ~AsyncLogger() {
+        Stop();
+        BOOST_FOREACH(ThreadLog * thread_log, thread_logs) {
+            delete thread_log;
+        }
+    }
+
+    //thread logs are owned by the logger, the drain thread may still read
+    //the ring of a thread that has exited
+    static void KeepThreadLog(ThreadLog *) { }
+
+    ThreadLog & GetThreadLog() {
+        ThreadLog * thread_log = current_thread_log.get();
+        if( !thread_log ) {
+            thread_log = new ThreadLog();
+            current_thread_log.reset(thread_log);
+            boost::mutex::scoped_lock lock(registry_mutex);
+            thread_logs.push_back(thread_log);
+        }
+        return *thread_log;
+    }
+
+    void Drain() {
+        bool keep_running = true;
+        while( keep_running ) {
+            //the last round drains what was logged before Stop()
+            keep_running = is_running;
+            std::size_t number_of_lines = 0;
+            std::vector<ThreadLog *> current_thread_logs;
+            {
+                boost::mutex::scoped_lock lock(registry_mutex);
+                current_thread_logs = thread_logs;
+            }
+            boost::mutex::scoped_lock lock(sink_mutex);
+            BOOST_FOREACH(ThreadLog * thread_log, current_thread_logs) {
+                AsyncLogLine line;
+                while( thread_log->ring.pop(line) ) {
+                    Print(line);
+                    ++number_of_lines;
+                }
+                const unsigned number_of_drops = thread_log->number_of_dropped_lines;
+                if( number_of_drops != thread_log->number_of_reported_drops ) {
+                    AsyncLogLine warning(logWARNING);
+                    warning << "dropped " <<
+                        (number_of_drops - thread_log->number_of_reported_drops) <<
+                        " log lines, logging falls behind";
+                    Print(warning);
+                    thread_log->number_of_reported_drops = number_of_drops;
+                }
+            }
+            std::cout.flush();
+            lock.unlock();
+            if( 0 == number_of_lines && keep_running ) {
+                boost::this_thread::sleep(
+                    boost::posix_time::milliseconds(ASYNC_LOG_IDLE_WAIT_MS)
+                );
+            }
+        }
+    }
+
+    //same format as SimpleLogger
+    void Print(const AsyncLogLine & line) const {
+        if( LogPolicy::GetInstance().IsMute() ) {
+            return;
+        }
+        std::ostream & sink = ( logWARNING == line.level ? std::cerr : std::cout );
+        switch(line.level) {
+        case logWARNING:
+            sink << "[warn] ";
+            break;
+        case logDEBUG:
+            sink << "[debug] ";
+            break;
+        default:
+            sink << "[info] ";
+            break;
+        }
+        sink.write(line.buffer, line.length);
+        sink << '\n';
+    }
+
+    boost::thread_specific_ptr<ThreadLog> current_thread_log;
+    boost::mutex registry_mutex;
+    std::vector<ThreadLog *> thread_logs;
+    boost::mutex sink_mutex;
+    boost::scoped_ptr<boost::thread> drain_thread;
+    unsigned minimum_severity;
+    unsigned access_sample_rate;
+    boost::atomic<bool> is_running;
+};
+
+#endif /* ASYNC_LOGGER_H_ */
@@ -0,0 +1,221 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include "OpenMPWrapper.h"
+
+#include <boost/integer.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// CRC32C (Castagnoli) with a zero initial value and no final xor, i.e. the
+// checksum of Algorithms/IteratorBasedCRC32.h and of the dataset container.
+// Uses the SSE4.2 crc32 instruction where available and slicing-by-8
+// tables elsewhere. Large buffers are split into chunks whose checksums
+// are computed in parallel and combined afterwards.
+
+//reflected polynomial 0x1EDC6F41
+const static uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+//each thread checksums chunks of this size
+const static uint64_t CRC32C_CHUNK_SIZE = 4 << 20;
+
+class CRC32CTables {
+public:
+    static const CRC32CTables & GetInstance() {
+        static CRC32CTables tables;
+        return tables;
+    }
+
+    uint32_t table[8][256];
+
+private:
+    CRC32CTables() {
+        for( uint32_t i = 0; i < 256; ++i ) {
+            uint32_t crc = i;
+            for( unsigned bit = 0; bit < 8; ++bit ) {
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+            }
+            table[0][i] = crc;
+        }
+        for( uint32_t i = 0; i < 256; ++i ) {
+            for( unsigned slice = 1; slice < 8; ++slice ) {
+                const uint32_t previous = table[slice-1][i];
+                table[slice][i] = (previous >> 8) ^ table[0][previous & 0xff];
+            }
+        }
+    }
+};
+
+inline uint32_t SoftwareCRC32C(uint32_t crc, const char * data, uint64_t size) {
+    const uint32_t (&table)[8][256] = CRC32CTables::GetInstance().table;
+    const unsigned char * bytes = reinterpret_cast<const unsigned char *>(data);
+    while( size >= 8 ) {
+        uint32_t low, high;
+        std::memcpy(&low, bytes, 4);
+        std::memcpy(&high, bytes + 4, 4);
+        low ^= crc;
+        crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^
+              table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+              table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^
+              table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+        bytes += 8;
+        size -= 8;
+    }
+    while( size-- ) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *bytes++) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__BIG_ENDIAN__)
+#define OSRM_HARDWARE_CRC32C
+
+inline bool HasCPUIDFeature(const unsigned ecx_bit) {
+    unsigned eax = 1, ebx, ecx, edx;
+    __asm__("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return 0 != (ecx & (1u << ecx_bit));
+}
+
+inline bool HasHardwareCRC32C() {
+    static const unsigned SSE42_BIT = 20;
+    static const bool has_sse42 = HasCPUIDFeature(SSE42_BIT);
+    return has_sse42;
+}
+
+inline uint32_t HardwareCRC32C(uint32_t crc, const char * data, uint64_t size) {
+    while( size > 0 && 0 != (reinterpret_cast<std::size_t>(data) & 7) ) {
+        __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*data));
+        ++data;
+        --size;
+    }
+    uint64_t crc64 = crc;
+    for( ; size >= 8; size -= 8, data += 8 ) {
+        __asm__("crc32q %1, %0" : "+r"(crc64) : "rm"(*reinterpret_cast<const uint64_t *>(data)));
+    }
+    crc = uint32_t(crc64);
+    while( size-- ) {
+        __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*data));
+        ++data;
+    }
+    return crc;
+}
+#else
+inline bool HasHardwareCRC32C() {
+    return false;
+}
+#endif
+
+//Continues crc over the next size bytes of a buffer
+inline uint32_t UpdateCRC32C(const uint32_t crc, const char * data, const uint64_t size) {
+#ifdef OSRM_HARDWARE_CRC32C
+    if( HasHardwareCRC32C() ) {
+        return HardwareCRC32C(crc, data, size);
+    }
+#endif
+    return SoftwareCRC32C(crc, data, size);
+}
+
+// Appending n zero bytes to a message is linear over GF(2) in its crc. The
+// 32x32 bit matrix of that map is stored as its 32 columns.
+inline uint32_t ApplyCRC32CMatrix(const uint32_t matrix[32], uint32_t crc) {
+    uint32_t result = 0;
+    for( unsigned column = 0; crc != 0; ++column, crc >>= 1 ) {
+        if( crc & 1 ) {
+            result ^= matrix[column];
+        }
+    }
+    return result;
+}
+
+inline void MultiplyCRC32CMatrices(
+    const uint32_t left[32],
+    const uint32_t right[32],
+    uint32_t product[32]
+) {
+    uint32_t result[32];
+    for( unsigned column = 0; column < 32; ++column ) {
+        result[column] = ApplyCRC32CMatrix(left, right[column]);
+    }
+    std::copy(result, result + 32, product);
+}
+
+//Computes the matrix that appends length zero bytes by repeated squaring
+inline void GetCRC32CShiftMatrix(uint64_t length, uint32_t shift[32]) {
+    uint32_t power[32];
+    //appending a single zero bit
+    power[0] = CRC32C_POLYNOMIAL;
+    for( unsigned column = 1; column < 32; ++column ) {
+        power[column] = 1u << (column - 1);
+    }
+    for( unsigned bit = 0; bit < 3; ++bit ) {
+        MultiplyCRC32CMatrices(power, power, power);
+    }
+    for( unsigned column = 0; column < 32; ++column ) {
+        shift[column] = 1u << column;
+    }
+    for( ; length != 0; length >>= 1 ) {
+        if( length & 1 ) {
+            MultiplyCRC32CMatrices(power, shift, shift);
+        }
+        MultiplyCRC32CMatrices(power, power, power);
+    }
+}
+
+//The crc of a buffer, chunks of it are checksummed by all threads
+inline uint32_t ComputeCRC32C(const char * data, const uint64_t size) {
+    if( size <= CRC32C_CHUNK_SIZE ) {
+        return UpdateCRC32C(0, data, size);
+    }
+    const int number_of_chunks = (size + CRC32C_CHUNK_SIZE - 1)/CRC32C_CHUNK_SIZE;
+    std::vector<uint32_t> chunk_crcs(number_of_chunks);
+    #pragma omp parallel for schedule(dynamic)
+    for( int i = 0; i < number_of_chunks; ++i ) {
+        const uint64_t chunk_begin = uint64_t(i)*CRC32C_CHUNK_SIZE;
+        chunk_crcs[i] = UpdateCRC32C(
+            0,
+            data + chunk_begin,
+            std::min(CRC32C_CHUNK_SIZE, size - chunk_begin)
+        );
+    }
+
+    //crc(a|b) is crc(a) shifted over the length of b, xor crc(b)
+    uint32_t chunk_shift[32];
+    GetCRC32CShiftMatrix(CRC32C_CHUNK_SIZE, chunk_shift);
+    uint32_t last_chunk_shift[32];
+    GetCRC32CShiftMatrix(
+        size - uint64_t(number_of_chunks - 1)*CRC32C_CHUNK_SIZE,
+        last_chunk_shift
+    );
+    uint32_t crc = chunk_crcs[0];
+    for( int i = 1; i < number_of_chunks; ++i ) {
+        crc = ApplyCRC32CMatrix(
+            (i + 1 < number_of_chunks) ? chunk_shift : last_chunk_shift,
+            crc
+        ) ^ chunk_crcs[i];
+    }
+    return crc;
+}
+
+#endif // CRC32C_H
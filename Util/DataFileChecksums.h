@@ -0,0 +1,155 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef DATA_FILE_CHECKSUMS_H
+#define DATA_FILE_CHECKSUMS_H
+
+#include "CRC32C.h"
+#include "FileLoader.h"
+#include "OSRMException.h"
+#include "SimpleLogger.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/integer.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// osrm-prepare lists size and CRC32C of each data file it leaves for
+// osrm-routed in a checksums file, one line per file:
+//   <crc32c in hex> <size in bytes> <file name without directory>
+// Loaders can verify the files against it before trusting their contents.
+
+//Maps a whole file and checksums it with all threads
+inline uint32_t ComputeFileCRC32C(const std::string & filename, uint64_t & file_size) {
+    if ( !boost::filesystem::exists( filename ) ) {
+        throw OSRMException(filename + " does not exist");
+    }
+    file_size = boost::filesystem::file_size( filename );
+    if( 0 == file_size ) {
+        return 0;
+    }
+    boost::interprocess::file_mapping file_mapping(
+        filename.c_str(),
+        boost::interprocess::read_only
+    );
+    boost::interprocess::mapped_region mapped_region(
+        file_mapping,
+        boost::interprocess::read_only
+    );
+    mapped_region.advise(boost::interprocess::mapped_region::advice_sequential);
+    return ComputeCRC32C(
+        static_cast<const char *>(mapped_region.get_address()),
+        file_size
+    );
+}
+
+inline void WriteDataFileChecksums(
+    const std::string & checksums_filename,
+    const std::vector<std::string> & data_filenames
+) {
+    boost::filesystem::ofstream checksums_stream(checksums_filename);
+    for( unsigned i = 0; i < data_filenames.size(); ++i ) {
+        uint64_t file_size = 0;
+        const uint32_t crc = ComputeFileCRC32C(data_filenames[i], file_size);
+        checksums_stream << std::hex << std::setw(8) << std::setfill('0') << crc <<
+            std::dec << " " << file_size << " " <<
+            boost::filesystem::path(data_filenames[i]).filename().string() << "\n";
+    }
+    checksums_stream.close();
+    if( !checksums_stream ) {
+        throw OSRMException("could not write " + checksums_filename);
+    }
+    SimpleLogger().Write() << "wrote checksums of " << data_filenames.size() <<
+        " data files to " << checksums_filename;
+}
+
+//Throws on the first file that differs from the checksums file. Files that
+//are not listed are only warned about.
+inline void VerifyDataFiles(
+    const std::string & checksums_filename,
+    const std::vector<std::string> & data_filenames
+) {
+    boost::filesystem::ifstream checksums_stream(checksums_filename);
+    if( !checksums_stream ) {
+        throw OSRMException("could not read checksums file " + checksums_filename);
+    }
+    std::map<std::string, std::pair<uint64_t, uint32_t> > expected_checksums;
+    std::string line;
+    while( std::getline(checksums_stream, line) ) {
+        std::istringstream line_stream(line);
+        uint32_t crc = 0;
+        uint64_t file_size = 0;
+        line_stream >> std::hex >> crc >> std::dec >> file_size >> std::ws;
+        std::string name;
+        std::getline(line_stream, name);
+        if( line_stream.fail() || name.empty() ) {
+            throw OSRMException("malformed line in " + checksums_filename + ": " + line);
+        }
+        expected_checksums[name] = std::make_pair(file_size, crc);
+    }
+
+    //truncated copies are found before any file is read
+    std::vector<std::pair<std::string, uint32_t> > files_to_verify;
+    for( unsigned i = 0; i < data_filenames.size(); ++i ) {
+        const std::string & filename = data_filenames[i];
+        const std::string name = boost::filesystem::path(filename).filename().string();
+        std::map<std::string, std::pair<uint64_t, uint32_t> >::const_iterator expected =
+            expected_checksums.find(name);
+        if( expected == expected_checksums.end() ) {
+            SimpleLogger().Write(logWARNING) << "no checksum for " << filename;
+            continue;
+        }
+        if( !boost::filesystem::exists( filename ) ||
+            expected->second.first != boost::filesystem::file_size( filename )
+        ) {
+            throw OSRMException(
+                filename + " is truncated or missing, expected " +
+                boost::lexical_cast<std::string>(expected->second.first) + " bytes"
+            );
+        }
+        files_to_verify.push_back(std::make_pair(filename, expected->second.second));
+    }
+
+    const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    uint64_t verified_bytes = 0;
+    for( unsigned i = 0; i < files_to_verify.size(); ++i ) {
+        uint64_t file_size = 0;
+        if( files_to_verify[i].second != ComputeFileCRC32C(files_to_verify[i].first, file_size) ) {
+            throw OSRMException(files_to_verify[i].first + " is corrupt, checksum mismatch");
+        }
+        verified_bytes += file_size;
+    }
+    const double seconds = GetSecondsSince(start);
+    const double megabytes = verified_bytes/double(1 << 20);
+    SimpleLogger().Write() << "verified checksums of " << megabytes <<
+        " MB of data files in " << seconds << "s, " <<
+        ((seconds > 0.) ? megabytes/seconds : 0.) << " MB/s";
+}
+
+#endif // DATA_FILE_CHECKSUMS_H
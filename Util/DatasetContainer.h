@@ -0,0 +1,358 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef DATASETCONTAINER_H_
+#define DATASETCONTAINER_H_
+
+#include "CRC32C.h"
+#include "FileLoader.h"
+#include "MemoryPlacement.h"
+#include "OpenMPWrapper.h"
+#include "OSRMException.h"
+#include "SimpleLogger.h"
+
+#include <boost/assert.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/integer.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+const static uint32_t DATASET_MAGIC_NUMBER = 0x44525344;
+const static uint32_t DATASET_VERSION = 1;
+//sections start on page boundaries, so that they can be mapped in place
+const static uint64_t DATASET_SECTION_ALIGNMENT = 4096;
+const static uint64_t DATASET_COPY_CHUNK_SIZE = 4 << 20;
+
+// Everything osrm-routed needs, in one file written by osrm-prepare.
+// Graph, edge records and search tree are stored as the arrays routed
+// works on, leafs, grid index, names and timestamp as the bytes of their
+// files. Each section has a CRC32C.
+struct DatasetSection {
+    enum SectionID {
+        GRAPH_NODES = 0,
+        GRAPH_EDGES,
+        EDGE_RECORDS,
+        RTREE_NODES,
+        RTREE_LEAF_OFFSETS,
+        RTREE_LEAFS,
+        GRID_INDEX,
+        NAMES,
+        TIMESTAMP,
+        NUMBER_OF_SECTIONS
+    };
+
+    static const char * GetName(const SectionID section_id) {
+        static const char * names[NUMBER_OF_SECTIONS] = {
+            "graph nodes",
+            "graph edges",
+            "edge records",
+            "r-tree nodes",
+            "r-tree leaf offsets",
+            "r-tree leafs",
+            "grid index",
+            "names",
+            "timestamp"
+        };
+        return names[section_id];
+    }
+
+    uint64_t offset;
+    uint64_t size;
+    uint32_t crc32;
+    uint32_t reserved;
+};
+
+struct DatasetHeader {
+    DatasetHeader() :
+        magic_number(DATASET_MAGIC_NUMBER),
+        version(DATASET_VERSION),
+        check_sum(0),
+        number_of_nodes(0)
+    {
+        for( unsigned i = 0; i < DatasetSection::NUMBER_OF_SECTIONS; ++i ) {
+            sections[i].offset = 0;
+            sections[i].size = 0;
+            sections[i].crc32 = 0;
+            sections[i].reserved = 0;
+        }
+    }
+
+    static inline uint64_t GetSectionOffset(const uint64_t end_of_previous_section) {
+        return (end_of_previous_section + DATASET_SECTION_ALIGNMENT - 1) /
+            DATASET_SECTION_ALIGNMENT * DATASET_SECTION_ALIGNMENT;
+    }
+
+    uint32_t magic_number;
+    uint32_t version;
+    uint32_t check_sum;
+    //node entries of the graph including the sentinel
+    uint32_t number_of_nodes;
+    DatasetSection sections[DatasetSection::NUMBER_OF_SECTIONS];
+};
+
+// Writes the container to a temporary file next to the target and renames
+// it when complete, so readers never see a partial container.
+class DatasetContainerWriter : boost::noncopyable {
+public:
+    DatasetContainerWriter(
+        const std::string & filename,
+        const unsigned check_sum,
+        const unsigned number_of_nodes
+    ) :
+        m_filename(filename),
+        m_temporary_filename(filename + ".tmp"),
+        m_output_stream(m_temporary_filename, std::ios::binary),
+        m_end_of_data(sizeof(DatasetHeader))
+    {
+        if( !m_output_stream ) {
+            throw OSRMException("could not open dataset container for writing");
+        }
+        m_header.check_sum = check_sum;
+        m_header.number_of_nodes = number_of_nodes;
+    }
+
+    template<typename T>
+    void WriteSection(
+        const DatasetSection::SectionID section_id,
+        const std::vector<T> & data
+    ) {
+        WriteSection(
+            section_id,
+            data.empty() ? NULL : reinterpret_cast<const char *>(&data[0]),
+            uint64_t(data.size())*sizeof(T)
+        );
+    }
+
+    void WriteSection(
+        const DatasetSection::SectionID section_id,
+        const char * data,
+        const uint64_t size
+    ) {
+        DatasetSection & section = BeginSection(section_id);
+        m_output_stream.write(data, size);
+        section.size = size;
+        section.crc32 = ComputeCRC32C(data, size);
+        m_end_of_data = section.offset + size;
+    }
+
+    //copies a whole file in chunks, empty file names give empty sections
+    void WriteSectionFromFile(
+        const DatasetSection::SectionID section_id,
+        const std::string & input_filename
+    ) {
+        DatasetSection & section = BeginSection(section_id);
+        if( input_filename.empty() ) {
+            return;
+        }
+        boost::filesystem::ifstream input_stream(input_filename, std::ios::binary);
+        if( !input_stream ) {
+            throw OSRMException("could not read " + input_filename);
+        }
+        std::vector<char> buffer(DATASET_COPY_CHUNK_SIZE);
+        while( input_stream ) {
+            input_stream.read(&buffer[0], buffer.size());
+            const std::streamsize bytes_read = input_stream.gcount();
+            m_output_stream.write(&buffer[0], bytes_read);
+            section.crc32 = UpdateCRC32C(section.crc32, &buffer[0], bytes_read);
+            section.size += bytes_read;
+        }
+        m_end_of_data = section.offset + section.size;
+    }
+
+    void Close() {
+        m_output_stream.seekp(0);
+        m_output_stream.write((char *)&m_header, sizeof(DatasetHeader));
+        m_output_stream.close();
+        if( !m_output_stream ) {
+            throw OSRMException("could not write dataset container");
+        }
+        boost::filesystem::rename(m_temporary_filename, m_filename);
+        SimpleLogger().Write() << "wrote dataset container of " <<
+            m_end_of_data << " bytes to " << m_filename;
+    }
+
+private:
+    DatasetSection & BeginSection(const DatasetSection::SectionID section_id) {
+        BOOST_ASSERT(section_id < DatasetSection::NUMBER_OF_SECTIONS);
+        DatasetSection & section = m_header.sections[section_id];
+        section.offset = DatasetHeader::GetSectionOffset(m_end_of_data);
+        section.size = 0;
+        section.crc32 = 0;
+        m_output_stream.seekp(section.offset);
+        return section;
+    }
+
+    const std::string m_filename;
+    const std::string m_temporary_filename;
+    boost::filesystem::ofstream m_output_stream;
+    DatasetHeader m_header;
+    uint64_t m_end_of_data;
+};
+
+// Read-only access to the sections of a container. The file is either
+// mapped, and the kernel is asked to prefetch it in one sequential pass,
+// or read into memory with one thread per section.
+class DatasetContainer : boost::noncopyable {
+public:
+    DatasetContainer(
+        const std::string & filename,
+        const bool read_into_memory
+    ) {
+        boost::filesystem::path container_file(filename);
+        if ( !boost::filesystem::exists( container_file ) ) {
+            throw OSRMException("dataset container does not exist");
+        }
+        const uint64_t file_size = boost::filesystem::file_size( container_file );
+        if ( file_size < sizeof(DatasetHeader) ) {
+            throw OSRMException("dataset container is truncated");
+        }
+        {
+            boost::filesystem::ifstream header_stream(container_file, std::ios::binary);
+            header_stream.read((char *)&m_header, sizeof(DatasetHeader));
+        }
+        if( DATASET_MAGIC_NUMBER != m_header.magic_number ) {
+            throw OSRMException("dataset container misses magic number");
+        }
+        if( DATASET_VERSION != m_header.version ) {
+            throw OSRMException("dataset container has an unknown version");
+        }
+        for( unsigned i = 0; i < DatasetSection::NUMBER_OF_SECTIONS; ++i ) {
+            if( file_size < m_header.sections[i].offset + m_header.sections[i].size ) {
+                throw OSRMException("dataset container is truncated");
+            }
+        }
+
+        const boost::posix_time::ptime time_before_load =
+            boost::posix_time::microsec_clock::universal_time();
+        if( read_into_memory ) {
+            ReadSections(filename, file_size);
+        } else {
+            boost::interprocess::file_mapping file_mapping(
+                filename.c_str(),
+                boost::interprocess::read_only
+            );
+            boost::interprocess::mapped_region mapped_region(
+                file_mapping,
+                boost::interprocess::read_only
+            );
+            m_file_mapping.swap(file_mapping);
+            m_mapped_region.swap(mapped_region);
+            m_mapped_region.advise(boost::interprocess::mapped_region::advice_willneed);
+            m_begin = static_cast<const char *>(m_mapped_region.get_address());
+        }
+        SimpleLogger().Write() << (read_into_memory ? "read " : "mapped ") <<
+            file_size << " bytes of dataset container in " <<
+            GetSecondsSince(time_before_load) << "s";
+    }
+
+    //Recomputes the CRC32C of every section, throws on the first mismatch.
+    //Each section is split over all threads, a mapped container is read in
+    //the process.
+    void VerifySections() const {
+        const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+        uint64_t verified_bytes = 0;
+        for( unsigned i = 0; i < DatasetSection::NUMBER_OF_SECTIONS; ++i ) {
+            const DatasetSection & section = m_header.sections[i];
+            if( section.crc32 != ComputeCRC32C(m_begin + section.offset, section.size) ) {
+                throw OSRMException(
+                    "dataset container is corrupt, checksum mismatch in " +
+                    std::string(DatasetSection::GetName(DatasetSection::SectionID(i))) +
+                    " section"
+                );
+            }
+            verified_bytes += section.size;
+        }
+        const double seconds = GetSecondsSince(start);
+        const double megabytes = verified_bytes/double(1 << 20);
+        SimpleLogger().Write() << "verified checksums of " << megabytes <<
+            " MB of dataset container in " << seconds << "s, " <<
+            ((seconds > 0.) ? megabytes/seconds : 0.) << " MB/s";
+    }
+
+    template<typename T>
+    const T * GetSection(const DatasetSection::SectionID section_id) const {
+        return reinterpret_cast<const T *>(m_begin + m_header.sections[section_id].offset);
+    }
+
+    template<typename T>
+    uint64_t GetNumberOfEntries(const DatasetSection::SectionID section_id) const {
+        return m_header.sections[section_id].size/sizeof(T);
+    }
+
+    uint64_t GetSectionSize(const DatasetSection::SectionID section_id) const {
+        return m_header.sections[section_id].size;
+    }
+
+    std::string GetString(const DatasetSection::SectionID section_id) const {
+        const char * begin = GetSection<char>(section_id);
+        return std::string(begin, begin + GetSectionSize(section_id));
+    }
+
+    unsigned GetCheckSum() const {
+        return m_header.check_sum;
+    }
+
+    unsigned GetNumberOfNodes() const {
+        return m_header.number_of_nodes;
+    }
+
+    void AdviseHugePages() const {
+        ::AdviseHugePages(
+            m_begin,
+            m_buffer.empty() ? m_mapped_region.get_size() : m_buffer.size()
+        );
+    }
+
+private:
+    void ReadSections(const std::string & filename, const uint64_t file_size) {
+        m_buffer.resize(file_size);
+        int number_of_failed_reads = 0;
+        #pragma omp parallel for schedule(dynamic) reduction(+:number_of_failed_reads)
+        for( int i = 0; i < int(DatasetSection::NUMBER_OF_SECTIONS); ++i ) {
+            const DatasetSection & section = m_header.sections[i];
+            if( 0 == section.size ) {
+                continue;
+            }
+            try {
+                ReadFileRange(filename, section.offset, &m_buffer[section.offset], section.size);
+            } catch(const std::exception &) {
+                ++number_of_failed_reads;
+            }
+        }
+        if( 0 != number_of_failed_reads ) {
+            throw OSRMException("could not read dataset container");
+        }
+        m_begin = &m_buffer[0];
+    }
+
+    DatasetHeader m_header;
+    boost::interprocess::file_mapping m_file_mapping;
+    boost::interprocess::mapped_region m_mapped_region;
+    std::vector<char> m_buffer;
+    const char * m_begin;
+};
+
+#endif /* DATASETCONTAINER_H_ */
@@ -0,0 +1,177 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef FILE_LOADER_H
+#define FILE_LOADER_H
+
+#include "OSRMException.h"
+#include "SimpleLogger.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/function.hpp>
+#include <boost/integer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//reads are split at multiples of this size, the next chunk is prefetched
+const static uint64_t FILE_LOADER_CHUNK_SIZE = 8 << 20;
+
+inline double GetSecondsSince(const boost::posix_time::ptime & start) {
+    return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds()/1e6;
+}
+
+//Reads size bytes at offset of a file in large aligned chunks. The kernel
+//is told that the range is read sequentially and each next chunk is
+//requested ahead. Logs the throughput, which tells if loading the file
+//is bound by the disk.
+inline void ReadFileRange(
+    const std::string & filename,
+    const uint64_t offset,
+    char * buffer,
+    const uint64_t size
+) {
+    if( 0 == size ) {
+        return;
+    }
+    const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+#ifndef _WIN32
+    const int file_descriptor = open(filename.c_str(), O_RDONLY);
+    if( -1 == file_descriptor ) {
+        throw OSRMException("could not open " + filename);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(file_descriptor, offset, size, POSIX_FADV_SEQUENTIAL);
+#endif
+    uint64_t bytes_read = 0;
+    while( bytes_read < size ) {
+        const uint64_t position = offset + bytes_read;
+        const uint64_t chunk_end = std::min(
+            offset + size,
+            (position/FILE_LOADER_CHUNK_SIZE + 1)*FILE_LOADER_CHUNK_SIZE
+        );
+#ifdef POSIX_FADV_WILLNEED
+        if( chunk_end < offset + size ) {
+            posix_fadvise(
+                file_descriptor,
+                chunk_end,
+                std::min(FILE_LOADER_CHUNK_SIZE, offset + size - chunk_end),
+                POSIX_FADV_WILLNEED
+            );
+        }
+#endif
+        const ssize_t result = pread(
+            file_descriptor,
+            buffer + bytes_read,
+            chunk_end - position,
+            position
+        );
+        if( -1 == result && EINTR == errno ) {
+            continue;
+        }
+        if( result <= 0 ) {
+            close(file_descriptor);
+            throw OSRMException(filename + " is truncated or could not be read");
+        }
+        bytes_read += result;
+    }
+    close(file_descriptor);
+#else
+    boost::filesystem::ifstream input_stream(filename, std::ios::binary);
+    input_stream.seekg(offset);
+    for( uint64_t bytes_read = 0; bytes_read < size; bytes_read += FILE_LOADER_CHUNK_SIZE ) {
+        input_stream.read(
+            buffer + bytes_read,
+            std::min(FILE_LOADER_CHUNK_SIZE, size - bytes_read)
+        );
+    }
+    if( !input_stream ) {
+        throw OSRMException(filename + " is truncated or could not be read");
+    }
+#endif
+    const double seconds = GetSecondsSince(start);
+    const double megabytes = size/double(1 << 20);
+    SimpleLogger().Write() << "read " << megabytes << " MB of " <<
+        boost::filesystem::path(filename).filename().string() << " in " << seconds <<
+        "s, " << ((seconds > 0.) ? megabytes/seconds : 0.) << " MB/s";
+}
+
+// Runs independent loading steps on threads of their own, they mostly wait
+// for the disk. The time each step took is logged. Compared to the read
+// throughput it tells if the step is bound by the disk or by the cpu.
+class ConcurrentLoader : boost::noncopyable {
+public:
+    void Add(const std::string & name, const boost::function<void()> & task) {
+        names.push_back(name);
+        tasks.push_back(task);
+    }
+
+    //Returns after all steps finished, rethrows the first error of a step
+    void Run() {
+        errors.assign(tasks.size(), std::string());
+        std::vector<boost::shared_ptr<boost::thread> > threads;
+        for( unsigned i = 1; i < tasks.size(); ++i ) {
+            threads.push_back(boost::shared_ptr<boost::thread>(
+                new boost::thread(boost::bind(&ConcurrentLoader::RunTask, this, i))
+            ));
+        }
+        if( !tasks.empty() ) {
+            RunTask(0);
+        }
+        for( unsigned i = 0; i < threads.size(); ++i ) {
+            threads[i]->join();
+        }
+        for( unsigned i = 0; i < errors.size(); ++i ) {
+            if( !errors[i].empty() ) {
+                throw OSRMException(errors[i]);
+            }
+        }
+    }
+
+private:
+    void RunTask(const unsigned i) {
+        const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+        try {
+            tasks[i]();
+            SimpleLogger().Write() << "loaded " << names[i] << " in " << GetSecondsSince(start) << "s";
+        } catch(const std::exception & e) {
+            errors[i] = e.what();
+        }
+    }
+
+    std::vector<std::string> names;
+    std::vector<boost::function<void()> > tasks;
+    std::vector<std::string> errors;
+};
+
+#endif // FILE_LOADER_H
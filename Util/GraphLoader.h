@@ -21,6 +21,7 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #ifndef GRAPHLOADER_H
 #define GRAPHLOADER_H
 
+#include "FileLoader.h"
 #include "OSRMException.h"
 #include "../DataStructures/ImportNode.h"
 #include "../DataStructures/ImportEdge.h"
@@ -400,6 +401,88 @@ NodeID readDDSGGraphFromStream(std::istream &in, std::vector<EdgeT>& edgeList, s
     return numberOfNodes;
 }
 
+//.hsgr files start with this header, files without it predate version 2
+const static unsigned HSGR_MAGIC_NUMBER = 0x52475348;
+const static unsigned HSGR_VERSION = 2;
+//sections start at page boundaries, so that they can be mapped in place
+const static uint64_t HSGR_SECTION_ALIGNMENT = 4096;
+
+// The header is followed by the UUID of the build, the node array and the
+// edge array. The node array holds number_of_nodes+1 entries, the last one
+// marks the end of the edges of the last node.
+struct HSGRHeader {
+    HSGRHeader() :
+        magic_number(HSGR_MAGIC_NUMBER),
+        version(HSGR_VERSION),
+        check_sum(0),
+        number_of_nodes(0),
+        number_of_edges(0),
+        reserved(0),
+        node_offset(0),
+        edge_offset(0)
+    { }
+
+    template<typename NodeT, typename EdgeT>
+    void SetSizes(const unsigned nodes, const unsigned edges) {
+        number_of_nodes = nodes;
+        number_of_edges = edges;
+        node_offset = GetSectionOffset(sizeof(HSGRHeader) + sizeof(UUID));
+        edge_offset = GetSectionOffset(node_offset + uint64_t(nodes+1)*sizeof(NodeT));
+    }
+
+    template<typename EdgeT>
+    uint64_t GetFileSize() const {
+        return edge_offset + uint64_t(number_of_edges)*sizeof(EdgeT);
+    }
+
+    static inline uint64_t GetSectionOffset(const uint64_t end_of_previous_section) {
+        return (end_of_previous_section + HSGR_SECTION_ALIGNMENT - 1) /
+            HSGR_SECTION_ALIGNMENT * HSGR_SECTION_ALIGNMENT;
+    }
+
+    uint32_t magic_number;
+    uint32_t version;
+    uint32_t check_sum;
+    uint32_t number_of_nodes;
+    uint32_t number_of_edges;
+    uint32_t reserved;
+    uint64_t node_offset;
+    uint64_t edge_offset;
+};
+
+//returns false for files in the format before version 2
+inline bool readHSGRHeader(
+    const std::string & hsgr_filename,
+    HSGRHeader & header
+) {
+    boost::filesystem::path hsgr_file(hsgr_filename);
+    if ( !boost::filesystem::exists( hsgr_file ) ) {
+        throw OSRMException("hsgr file does not exist");
+    }
+    const uint64_t file_size = boost::filesystem::file_size( hsgr_file );
+    if ( file_size < sizeof(HSGRHeader) ) {
+        return false;
+    }
+    boost::filesystem::ifstream hsgr_input_stream(hsgr_file, std::ios::binary);
+    hsgr_input_stream.read((char *)&header, sizeof(HSGRHeader));
+    if ( HSGR_MAGIC_NUMBER != header.magic_number ) {
+        return false;
+    }
+    if ( HSGR_VERSION != header.version ) {
+        throw OSRMException("hsgr file has an unknown version");
+    }
+    UUID uuid_loaded, uuid_orig;
+    hsgr_input_stream.read((char *)&uuid_loaded, sizeof(UUID));
+    if( !uuid_loaded.TestGraphUtil(uuid_orig) ) {
+        SimpleLogger().Write(logWARNING) <<
+            ".hsgr was prepared with different build. "
+            "Reprocess to get rid of this warning.";
+    }
+    BOOST_ASSERT_MSG( 0 != header.number_of_nodes, "number of nodes is zero");
+    BOOST_ASSERT_MSG( 0 != header.number_of_edges, "number of edges is zero");
+    return true;
+}
+
 template<typename NodeT, typename EdgeT>
 unsigned readHSGRFromStream(
     const std::string & hsgr_filename,
@@ -415,6 +498,29 @@ unsigned readHSGRFromStream(
         throw OSRMException("hsgr file is empty");
     }
 
+    HSGRHeader header;
+    if( readHSGRHeader(hsgr_filename, header) ) {
+        if( boost::filesystem::file_size( hsgr_file ) < header.GetFileSize<EdgeT>() ) {
+            throw OSRMException("hsgr file is truncated");
+        }
+        *check_sum = header.check_sum;
+        node_list.resize(header.number_of_nodes + 1);
+        ReadFileRange(
+            hsgr_filename,
+            header.node_offset,
+            (char*) &(node_list[0]),
+            uint64_t(header.number_of_nodes + 1)*sizeof(NodeT)
+        );
+        edge_list.resize(header.number_of_edges);
+        ReadFileRange(
+            hsgr_filename,
+            header.edge_offset,
+            (char*) &(edge_list[0]),
+            uint64_t(header.number_of_edges)*sizeof(EdgeT)
+        );
+        return header.number_of_nodes + 1;
+    }
+
     boost::filesystem::ifstream hsgr_input_stream(hsgr_file, std::ios::binary);
 
     UUID uuid_loaded, uuid_orig;
@@ -429,24 +535,34 @@ unsigned readHSGRFromStream(
     hsgr_input_stream.read((char*) check_sum, sizeof(unsigned));
     hsgr_input_stream.read((char*) & number_of_nodes, sizeof(unsigned));
     BOOST_ASSERT_MSG( 0 != number_of_nodes, "number of nodes is zero");
-    node_list.resize(number_of_nodes + 1);
-    hsgr_input_stream.read(
-        (char*) &(node_list[0]),
-        number_of_nodes*sizeof(NodeT)
-    );
+    const uint64_t node_offset = sizeof(UUID) + 2*sizeof(unsigned);
+    const uint64_t edge_count_offset = node_offset + uint64_t(number_of_nodes)*sizeof(NodeT);
     unsigned number_of_edges = 0;
+    hsgr_input_stream.seekg(edge_count_offset);
     hsgr_input_stream.read(
         (char*) &number_of_edges,
         sizeof(unsigned)
     );
+    if( !hsgr_input_stream ) {
+        throw OSRMException("hsgr file is truncated");
+    }
     BOOST_ASSERT_MSG( 0 != number_of_edges, "number of edges is zero");
+    hsgr_input_stream.close();
 
+    node_list.resize(number_of_nodes + 1);
+    ReadFileRange(
+        hsgr_filename,
+        node_offset,
+        (char*) &(node_list[0]),
+        uint64_t(number_of_nodes)*sizeof(NodeT)
+    );
     edge_list.resize(number_of_edges);
-    hsgr_input_stream.read(
+    ReadFileRange(
+        hsgr_filename,
+        edge_count_offset + sizeof(unsigned),
         (char*) &(edge_list[0]),
-        number_of_edges*sizeof(EdgeT)
+        uint64_t(number_of_edges)*sizeof(EdgeT)
     );
-    hsgr_input_stream.close();
     return number_of_nodes;
 }
 
@@ -0,0 +1,226 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, others 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef MEMORY_PLACEMENT_H
+#define MEMORY_PLACEMENT_H
+
+#include "SimpleLogger.h"
+#include "StringUtil.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/integer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//size of a transparent huge page on x86-64
+const static uint64_t HUGE_PAGE_SIZE = 2 << 20;
+
+// Helpers to place the read-only query data. On other platforms than Linux
+// they do nothing and report a single NUMA node that holds all cpus.
+
+struct NUMANode {
+    unsigned id;
+    std::vector<unsigned> cpus;
+
+    inline bool operator<(const NUMANode & other) const {
+        return id < other.id;
+    }
+};
+
+//Asks the kernel to back the huge page aligned part of an array with
+//transparent huge pages, no matter if it is on the heap, in shared memory
+//or in a mapped file. It depends on the kernel's configuration which of
+//these it honors.
+inline void AdviseHugePages(const void * begin, const uint64_t size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const uintptr_t first = (uintptr_t(begin) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    const uintptr_t last = (uintptr_t(begin) + size) & ~(HUGE_PAGE_SIZE - 1);
+    //arrays smaller than a huge page are left alone
+    if( last <= first ) {
+        return;
+    }
+    if( 0 != madvise(reinterpret_cast<void *>(first), last - first, MADV_HUGEPAGE) ) {
+        SimpleLogger().Write(logDEBUG) << "no huge pages for " << (size >> 20) << " MB";
+    }
+#endif
+}
+
+//Parses cpu lists like "0-3,8-11" as found in sysfs
+inline std::vector<unsigned> ParseCPUList(const std::string & cpu_list) {
+    std::vector<unsigned> cpus;
+    std::vector<std::string> ranges;
+    stringSplit(cpu_list, ',', ranges);
+    for(unsigned i = 0; i < ranges.size(); ++i) {
+        const std::string::size_type dash = ranges[i].find('-');
+        const unsigned first = stringToInt(ranges[i].substr(0, dash));
+        const unsigned last = (std::string::npos == dash) ?
+            first : stringToInt(ranges[i].substr(dash+1));
+        for(unsigned cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+//Nodes are sorted by id and only nodes with cpus are listed
+inline std::vector<NUMANode> GetNUMANodes() {
+    std::vector<NUMANode> nodes;
+#ifdef __linux__
+    const boost::filesystem::path node_directory("/sys/devices/system/node");
+    if( boost::filesystem::is_directory(node_directory) ) {
+        for(
+            boost::filesystem::directory_iterator it(node_directory), end;
+            it != end;
+            ++it
+        ) {
+            const std::string name = it->path().filename().string();
+            if( name.size() <= 4 || 0 != name.compare(0, 4, "node") ||
+                std::string::npos != name.find_first_not_of("0123456789", 4)
+            ) {
+                continue;
+            }
+            boost::filesystem::ifstream cpu_list_stream(it->path() / "cpulist");
+            std::string cpu_list;
+            std::getline(cpu_list_stream, cpu_list);
+            NUMANode node;
+            node.id = stringToInt(name.substr(4));
+            node.cpus = ParseCPUList(cpu_list);
+            if( !node.cpus.empty() ) {
+                nodes.push_back(node);
+            }
+        }
+    }
+#endif
+    if( nodes.empty() ) {
+        NUMANode node;
+        node.id = 0;
+        for(unsigned cpu = 0; cpu < std::max(1u, boost::thread::hardware_concurrency()); ++cpu) {
+            node.cpus.push_back(cpu);
+        }
+        nodes.push_back(node);
+    }
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+}
+
+//cpu the calling thread runs on, 0 if unknown
+inline unsigned GetCurrentCPU() {
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+    return (cpu < 0) ? 0 : cpu;
+#else
+    return 0;
+#endif
+}
+
+#ifdef __linux__
+inline bool BindThreadToCPUs(const pthread_t thread, const std::vector<unsigned> & cpus) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for(unsigned i = 0; i < cpus.size(); ++i) {
+        CPU_SET(cpus[i], &cpu_set);
+    }
+    return 0 == pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpu_set);
+}
+#endif
+
+//Runs the calling thread on the cpus of a NUMA node while in scope. Memory
+//it touches first is allocated on that node by the kernel's default policy.
+class ScopedNUMANodeBinding : boost::noncopyable {
+public:
+    explicit ScopedNUMANodeBinding(const NUMANode & node) : isBound(false) {
+#ifdef __linux__
+        isBound =
+            0 == pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &previousCPUs) &&
+            BindThreadToCPUs(pthread_self(), node.cpus);
+        if( !isBound ) {
+            SimpleLogger().Write(logWARNING) << "could not bind to NUMA node " << node.id;
+        }
+#endif
+    }
+
+    ~ScopedNUMANodeBinding() {
+#ifdef __linux__
+        if( isBound ) {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &previousCPUs);
+        }
+#endif
+    }
+
+private:
+    bool isBound;
+#ifdef __linux__
+    cpu_set_t previousCPUs;
+#endif
+};
+
+//Spreads the pages that the calling thread allocates while in scope round
+//robin over all NUMA nodes
+class ScopedInterleavedMemoryPolicy : boost::noncopyable {
+public:
+    explicit ScopedInterleavedMemoryPolicy(const std::vector<NUMANode> & nodes) :
+        isSet(false)
+    {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+        std::vector<unsigned long> node_mask(nodes.back().id/(8*sizeof(unsigned long)) + 1, 0);
+        for(unsigned i = 0; i < nodes.size(); ++i) {
+            node_mask[nodes[i].id/(8*sizeof(unsigned long))] |=
+                1UL << (nodes[i].id%(8*sizeof(unsigned long)));
+        }
+        //the kernel ignores the last bit of maxnode
+        isSet = 0 == syscall(
+            SYS_set_mempolicy,
+            MPOL_INTERLEAVE,
+            &node_mask[0],
+            node_mask.size()*8*sizeof(unsigned long) + 1
+        );
+#endif
+        if( !isSet ) {
+            SimpleLogger().Write(logWARNING) << "could not interleave memory over NUMA nodes";
+        }
+    }
+
+    ~ScopedInterleavedMemoryPolicy() {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+        if( isSet ) {
+            syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+        }
+#endif
+    }
+
+private:
+    bool isSet;
+};
+
+#endif // MEMORY_PLACEMENT_H
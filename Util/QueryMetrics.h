@@ -0,0 +1,369 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+#ifndef QUERY_METRICS_H_
+#define QUERY_METRICS_H_
+
+#include <boost/atomic.hpp>
+#include <boost/foreach.hpp>
+#include <boost/integer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#ifdef _WIN32
+#include <boost/date_time/posix_time/posix_time.hpp>
+#else
+#include <time.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//services that are not registered share the first slot
+const static unsigned MAX_METRICS_SERVICES = 16;
+//two buckets per power of two, the last finite bound is 2^32
+const static unsigned NUMBER_OF_METRICS_BUCKETS = 65;
+
+enum MetricsPhase {
+    phaseParse = 0,
+    phaseSnapping,
+    phaseSearch,
+    phaseUnpack,
+    phaseDescribe,
+    phaseCompress,
+    phaseWrite,
+    NUMBER_OF_METRICS_PHASES
+};
+
+enum MetricsCount {
+    countSettledNodes = 0,
+    countHeapSize,
+    NUMBER_OF_METRICS_COUNTS
+};
+
+// Latency and search space statistics of the running server. Each thread
+// records into histograms of its own, so recording neither locks nor shares
+// cache lines with other threads. Histograms are log-linear like HDR
+// histograms, the bounds of a bucket are 2^k, 1.5*2^k and 2^(k+1). They are
+// only merged when they are exported. Services are registered at startup
+// before requests are answered.
+class QueryMetrics : boost::noncopyable {
+public:
+    static QueryMetrics & GetInstance() {
+        static QueryMetrics runningInstance;
+        return runningInstance;
+    }
+
+    //returns the slot of the service
+    unsigned RegisterService(const std::string & service) {
+        boost::mutex::scoped_lock lock(registry_mutex);
+        const unsigned service_id = GetServiceID(service);
+        if( 0 != service_id || MAX_METRICS_SERVICES == number_of_services ) {
+            return service_id;
+        }
+        service_names[number_of_services] = service;
+        return number_of_services++;
+    }
+
+    unsigned GetServiceID(const std::string & service) const {
+        const unsigned registered_services = number_of_services;
+        for( unsigned i = 1; i < registered_services; ++i ) {
+            if( service == service_names[i] ) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    //service to which phases of the calling thread are attributed
+    void SetCurrentService(const unsigned service_id) {
+        GetThreadMetrics().current_service = service_id;
+    }
+
+    void RecordPhase(const MetricsPhase phase, const uint64_t microseconds) {
+        ThreadMetrics & thread_metrics = GetThreadMetrics();
+        thread_metrics.phases[thread_metrics.current_service][phase].Add(microseconds);
+    }
+
+    void RecordPhase(
+        const MetricsPhase phase,
+        const unsigned service_id,
+        const uint64_t microseconds
+    ) {
+        GetThreadMetrics().phases[service_id][phase].Add(microseconds);
+    }
+
+    //search space of a single shortest path search
+    void RecordSearch(const uint64_t settled_nodes, const uint64_t heap_size) {
+        ThreadMetrics & thread_metrics = GetThreadMetrics();
+        const unsigned service_id = thread_metrics.current_service;
+        thread_metrics.counts[service_id][countSettledNodes].Add(settled_nodes);
+        thread_metrics.counts[service_id][countHeapSize].Add(heap_size);
+    }
+
+    //appends all histograms in the Prometheus text format
+    void Export(std::string & output) {
+        std::vector<ThreadMetrics *> current_thread_metrics;
+        {
+            boost::mutex::scoped_lock lock(registry_mutex);
+            current_thread_metrics = thread_metrics;
+        }
+        const unsigned registered_services = number_of_services;
+
+        output += "# HELP osrm_phase_duration_seconds Duration of the phases of a request\n";
+        output += "# TYPE osrm_phase_duration_seconds histogram\n";
+        for( unsigned service_id = 0; service_id < registered_services; ++service_id ) {
+            for( unsigned phase = 0; phase < NUMBER_OF_METRICS_PHASES; ++phase ) {
+                HistogramSnapshot snapshot;
+                BOOST_FOREACH(const ThreadMetrics * metrics, current_thread_metrics) {
+                    snapshot.Merge(metrics->phases[service_id][phase]);
+                }
+                std::string labels = "service=\"" + service_names[service_id] +
+                    "\",phase=\"" + GetPhaseName(phase) + "\"";
+                snapshot.Export("osrm_phase_duration_seconds", labels, 1e-6, output);
+            }
+        }
+
+        const char * count_names[NUMBER_OF_METRICS_COUNTS] = {
+            "osrm_search_settled_nodes",
+            "osrm_search_heap_size"
+        };
+        const char * count_descriptions[NUMBER_OF_METRICS_COUNTS] = {
+            "Nodes settled by a search",
+            "Nodes inserted into the heaps of a search"
+        };
+        for( unsigned count = 0; count < NUMBER_OF_METRICS_COUNTS; ++count ) {
+            output += "# HELP ";
+            output += count_names[count];
+            output += " ";
+            output += count_descriptions[count];
+            output += "\n# TYPE ";
+            output += count_names[count];
+            output += " histogram\n";
+            for( unsigned service_id = 0; service_id < registered_services; ++service_id ) {
+                HistogramSnapshot snapshot;
+                BOOST_FOREACH(const ThreadMetrics * metrics, current_thread_metrics) {
+                    snapshot.Merge(metrics->counts[service_id][count]);
+                }
+                std::string labels = "service=\"" + service_names[service_id] + "\"";
+                snapshot.Export(count_names[count], labels, 1., output);
+            }
+        }
+    }
+
+    //monotonic clock for phase durations
+    static inline uint64_t GetMicroseconds() {
+#ifdef _WIN32
+        static const boost::posix_time::ptime epoch =
+            boost::posix_time::microsec_clock::universal_time();
+        return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds();
+#else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return uint64_t(now.tv_sec)*1000000 + now.tv_nsec/1000;
+#endif
+    }
+
+private:
+    //values up to 1 go to the first bucket, larger ones to the bucket
+    //whose upper bound is the next of 2, 3, 4, 6, 8, 12, ...
+    static inline unsigned GetBucket(const uint64_t value) {
+        if( value <= 1 ) {
+            return 0;
+        }
+        const uint64_t x = value - 1;
+        unsigned msb = 0;
+        while( (x >> msb) > 1 ) {
+            ++msb;
+        }
+        const unsigned bucket = ( 0 == msb ? 1 : 2*msb + ((x >> (msb-1)) & 1) );
+        return std::min(bucket, NUMBER_OF_METRICS_BUCKETS-1);
+    }
+
+    static inline double GetBucketBound(const unsigned bucket) {
+        if( bucket < 2 ) {
+            return bucket + 1;
+        }
+        const double power = double(uint64_t(1) << (bucket/2));
+        return ( 0 == bucket % 2 ? 1.5*power : 2*power );
+    }
+
+    static const char * GetPhaseName(const unsigned phase) {
+        const char * phase_names[NUMBER_OF_METRICS_PHASES] = {
+            "parse",
+            "snapping",
+            "search",
+            "unpack",
+            "describe",
+            "compress",
+            "write"
+        };
+        return phase_names[phase];
+    }
+
+    // Only the owning thread writes, exporting threads read concurrently
+    struct Histogram {
+        Histogram() : sum(0), count(0) {
+            for( unsigned i = 0; i < NUMBER_OF_METRICS_BUCKETS; ++i ) {
+                buckets[i] = 0;
+            }
+        }
+
+        inline void Add(const uint64_t value) {
+            Increment(buckets[GetBucket(value)], 1);
+            Increment(sum, value);
+            Increment(count, 1);
+        }
+
+        //a single writer does not need atomic read-modify-write
+        static inline void Increment(boost::atomic<uint64_t> & counter, const uint64_t value) {
+            counter.store(
+                counter.load(boost::memory_order_relaxed) + value,
+                boost::memory_order_relaxed
+            );
+        }
+
+        boost::atomic<uint64_t> buckets[NUMBER_OF_METRICS_BUCKETS];
+        boost::atomic<uint64_t> sum;
+        boost::atomic<uint64_t> count;
+    };
+
+    struct HistogramSnapshot {
+        HistogramSnapshot() : buckets(NUMBER_OF_METRICS_BUCKETS, 0), sum(0), count(0) { }
+
+        void Merge(const Histogram & histogram) {
+            for( unsigned i = 0; i < NUMBER_OF_METRICS_BUCKETS; ++i ) {
+                buckets[i] += histogram.buckets[i].load(boost::memory_order_relaxed);
+            }
+            sum += histogram.sum.load(boost::memory_order_relaxed);
+            count += histogram.count.load(boost::memory_order_relaxed);
+        }
+
+        //unused histograms are left out. Buckets are cumulative, the last
+        //one has no upper bound.
+        void Export(
+            const char * name,
+            const std::string & labels,
+            const double unit,
+            std::string & output
+        ) const {
+            if( 0 == count ) {
+                return;
+            }
+            char line[256];
+            uint64_t cumulative_count = 0;
+            for( unsigned i = 0; i < NUMBER_OF_METRICS_BUCKETS; ++i ) {
+                cumulative_count += buckets[i];
+                if( i+1 < NUMBER_OF_METRICS_BUCKETS ) {
+                    std::snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%.9g\"} %llu\n",
+                        name, labels.c_str(), unit*GetBucketBound(i),
+                        (unsigned long long)cumulative_count);
+                } else {
+                    std::snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %llu\n",
+                        name, labels.c_str(), (unsigned long long)cumulative_count);
+                }
+                output += line;
+            }
+            std::snprintf(line, sizeof(line), "%s_sum{%s} %.9g\n%s_count{%s} %llu\n",
+                name, labels.c_str(), unit*sum,
+                name, labels.c_str(), (unsigned long long)cumulative_count);
+            output += line;
+        }
+
+        std::vector<uint64_t> buckets;
+        uint64_t sum;
+        uint64_t count;
+    };
+
+    struct ThreadMetrics : boost::noncopyable {
+        ThreadMetrics() : current_service(0) { }
+        unsigned current_service;
+        Histogram phases[MAX_METRICS_SERVICES][NUMBER_OF_METRICS_PHASES];
+        Histogram counts[MAX_METRICS_SERVICES][NUMBER_OF_METRICS_COUNTS];
+    };
+
+    QueryMetrics() :
+        current_thread_metrics(&QueryMetrics::KeepThreadMetrics),
+        number_of_services(1)
+    {
+        service_names[0] = "other";
+    }
+
+    ~QueryMetrics() {
+        BOOST_FOREACH(ThreadMetrics * metrics, thread_metrics) {
+            delete metrics;
+        }
+    }
+
+    //the numbers of exited threads still count
+    static void KeepThreadMetrics(ThreadMetrics *) { }
+
+    ThreadMetrics & GetThreadMetrics() {
+        ThreadMetrics * metrics = current_thread_metrics.get();
+        if( !metrics ) {
+            metrics = new ThreadMetrics();
+            current_thread_metrics.reset(metrics);
+            boost::mutex::scoped_lock lock(registry_mutex);
+            thread_metrics.push_back(metrics);
+        }
+        return *metrics;
+    }
+
+    boost::thread_specific_ptr<ThreadMetrics> current_thread_metrics;
+    boost::mutex registry_mutex;
+    std::vector<ThreadMetrics *> thread_metrics;
+    std::string service_names[MAX_METRICS_SERVICES];
+    boost::atomic<unsigned> number_of_services;
+};
+
+// Records the time until it goes out of scope or is stopped, whichever
+// comes first, as a phase of the current service of the thread.
+class ScopedPhaseTimer : boost::noncopyable {
+public:
+    explicit ScopedPhaseTimer(const MetricsPhase p) :
+        phase(p),
+        start(QueryMetrics::GetMicroseconds()),
+        is_running(true)
+    { }
+
+    ~ScopedPhaseTimer() {
+        Stop();
+    }
+
+    void Stop() {
+        if( is_running ) {
+            QueryMetrics::GetInstance().RecordPhase(
+                phase,
+                QueryMetrics::GetMicroseconds() - start
+            );
+            is_running = false;
+        }
+    }
+
+private:
+    const MetricsPhase phase;
+    const uint64_t start;
+    bool is_running;
+};
+
+#endif /* QUERY_METRICS_H_ */
@@ -23,9 +23,12 @@ or see http://www.gnu.org/licenses/agpl.txt.
 #include "Contractor/EdgeBasedGraphFactory.h"
 #include "DataStructures/BinaryHeap.h"
 #include "DataStructures/DeallocatingVector.h"
+#include "DataStructures/NodeInformationHelpDesk.h"
 #include "DataStructures/QueryEdge.h"
 #include "DataStructures/StaticGraph.h"
 #include "DataStructures/StaticRTree.h"
+#include "Util/DataFileChecksums.h"
+#include "Util/DatasetContainer.h"
 #include "Util/IniFile.h"
 #include "Util/GraphLoader.h"
 #include "Util/InputFileUtil.h"
@@ -58,6 +61,71 @@ std::vector<NodeID> bollardNodes;
 std::vector<NodeID> trafficLightNodes;
 std::vector<ImportEdge> edgeList;
 
+//The data files osrm-routed reads, the timestamp is optional
+std::vector<std::string> GetDataFiles(const std::string & base_path) {
+    const char * extensions[] = {
+        ".hsgr", ".nodes", ".edges", ".ramIndex", ".fileIndex", ".gridIndex", ".names"
+    };
+    std::vector<std::string> data_files;
+    for( unsigned i = 0; i < sizeof(extensions)/sizeof(extensions[0]); ++i ) {
+        data_files.push_back(base_path + extensions[i]);
+    }
+    if( boost::filesystem::exists(base_path + ".timestamp") ) {
+        data_files.push_back(base_path + ".timestamp");
+    }
+    return data_files;
+}
+
+//Packs the files written for osrm-routed into one dataset container
+void WriteDatasetContainer(const std::string & base_path) {
+    SimpleLogger().Write() << "writing dataset container ...";
+    std::vector< StaticGraph<EdgeData>::_StrNode > node_list;
+    std::vector< StaticGraph<EdgeData>::_StrEdge > edge_list;
+    unsigned check_sum = 0;
+    const unsigned number_of_nodes = readHSGRFromStream(
+        base_path + ".hsgr",
+        node_list,
+        edge_list,
+        &check_sum
+    );
+    node_list.resize(number_of_nodes);
+
+    DatasetContainerWriter container_writer(
+        base_path + ".dataset",
+        check_sum,
+        number_of_nodes
+    );
+    container_writer.WriteSection(DatasetSection::GRAPH_NODES, node_list);
+    container_writer.WriteSection(DatasetSection::GRAPH_EDGES, edge_list);
+    std::vector< StaticGraph<EdgeData>::_StrNode >().swap(node_list);
+    std::vector< StaticGraph<EdgeData>::_StrEdge >().swap(edge_list);
+
+    std::vector<NodeInformationHelpDesk::OriginalEdgeRecord> edge_records;
+    NodeInformationHelpDesk::LoadEdgeRecords(
+        base_path + ".nodes",
+        base_path + ".edges",
+        edge_records
+    );
+    container_writer.WriteSection(DatasetSection::EDGE_RECORDS, edge_records);
+    std::vector<NodeInformationHelpDesk::OriginalEdgeRecord>().swap(edge_records);
+
+    std::vector<StaticRTree<RTreeLeaf>::SearchTreeNode> search_tree;
+    std::vector<uint64_t> leaf_offsets;
+    StaticRTree<RTreeLeaf>::LoadSearchTree(base_path + ".ramIndex", search_tree, leaf_offsets);
+    container_writer.WriteSection(DatasetSection::RTREE_NODES, search_tree);
+    container_writer.WriteSection(DatasetSection::RTREE_LEAF_OFFSETS, leaf_offsets);
+    container_writer.WriteSectionFromFile(DatasetSection::RTREE_LEAFS, base_path + ".fileIndex");
+    container_writer.WriteSectionFromFile(DatasetSection::GRID_INDEX, base_path + ".gridIndex");
+    container_writer.WriteSectionFromFile(DatasetSection::NAMES, base_path + ".names");
+    //the timestamp is optional
+    const std::string timestamp_path = base_path + ".timestamp";
+    container_writer.WriteSectionFromFile(
+        DatasetSection::TIMESTAMP,
+        boost::filesystem::exists(timestamp_path) ? timestamp_path : ""
+    );
+    container_writer.Close();
+}
+
 int main (int argc, char *argv[]) {
     try {
         LogPolicy::GetInstance().Unmute();
@@ -70,11 +138,14 @@ int main (int argc, char *argv[]) {
 
         double startupTime = get_timestamp();
         unsigned number_of_threads = omp_get_num_procs();
+        bool write_dataset_container = false;
         if(testDataFile("contractor.ini")) {
             ContractorConfiguration contractorConfig("contractor.ini");
             unsigned rawNumber = stringToInt(contractorConfig.GetParameter("Threads"));
             if(rawNumber != 0 && rawNumber <= number_of_threads)
                 number_of_threads = rawNumber;
+            write_dataset_container =
+                (1 == stringToInt(contractorConfig.GetParameter("WriteDataset")));
         }
         omp_set_num_threads(number_of_threads);
         LogPolicy::GetInstance().Unmute();
@@ -117,6 +188,7 @@ int main (int argc, char *argv[]) {
         std::string graphOut(argv[1]);		graphOut += ".hsgr";
         std::string rtree_nodes_path(argv[1]);  rtree_nodes_path += ".ramIndex";
         std::string rtree_leafs_path(argv[1]);  rtree_leafs_path += ".fileIndex";
+        std::string grid_index_path(argv[1]);   grid_index_path += ".gridIndex";
 
         /*** Setup Scripting Environment ***/
         if(!testDataFile( (argc > 3 ? argv[3] : "profile.lua") )) {
@@ -227,7 +299,8 @@ int main (int argc, char *argv[]) {
                 new StaticRTree<EdgeBasedGraphFactory::EdgeBasedNode>(
                         nodeBasedEdgeList,
                         rtree_nodes_path.c_str(),
-                        rtree_leafs_path.c_str()
+                        rtree_leafs_path.c_str(),
+                        grid_index_path.c_str()
                 );
         delete rtree;
         IteratorbasedCRC32<std::vector<EdgeBasedGraphFactory::EdgeBasedNode> > crc32;
@@ -267,7 +340,6 @@ int main (int argc, char *argv[]) {
             " edges";
 
         std::ofstream hsgr_output_stream(graphOut.c_str(), std::ios::binary);
-        hsgr_output_stream.write((char*)&uuid_orig, sizeof(UUID) );
         BOOST_FOREACH(const QueryEdge & edge, contractedEdgeList) {
             if(edge.source > numberOfNodes) {
                 numberOfNodes = edge.source;
@@ -290,14 +362,18 @@ int main (int argc, char *argv[]) {
             _nodes[node].firstEdge = position; //=edge
             position += edge - lastEdge; //remove
         }
-        ++numberOfNodes;
-        //Serialize numberOfNodes, nodes
-        hsgr_output_stream.write((char*) &crc32OfNodeBasedEdgeList, sizeof(unsigned));
-        hsgr_output_stream.write((char*) &numberOfNodes, sizeof(unsigned));
-        hsgr_output_stream.write((char*) &_nodes[0], sizeof(StaticGraph<EdgeData>::_StrNode)*(numberOfNodes));
-        //Serialize number of Edges
-        hsgr_output_stream.write((char*) &position, sizeof(unsigned));
-        --numberOfNodes;
+        //Serialize header, nodes and edges into aligned sections
+        HSGRHeader hsgr_header;
+        hsgr_header.check_sum = crc32OfNodeBasedEdgeList;
+        hsgr_header.SetSizes<
+            StaticGraph<EdgeData>::_StrNode,
+            StaticGraph<EdgeData>::_StrEdge
+        >(numberOfNodes, position);
+        hsgr_output_stream.write((char*) &hsgr_header, sizeof(HSGRHeader));
+        hsgr_output_stream.write((char*) &uuid_orig, sizeof(UUID) );
+        hsgr_output_stream.seekp(hsgr_header.node_offset);
+        hsgr_output_stream.write((char*) &_nodes[0], sizeof(StaticGraph<EdgeData>::_StrNode)*(numberOfNodes+1));
+        hsgr_output_stream.seekp(hsgr_header.edge_offset);
         edge = 0;
         int usedEdgeCounter = 0;
         StaticGraph<EdgeData>::_StrEdge currentEdge;
@@ -337,6 +413,16 @@ int main (int argc, char *argv[]) {
         hsgr_output_stream.close();
         //cleanedEdgeList.clear();
         _nodes.clear();
+        contractedEdgeList.clear();
+
+        /***
+         * Checksumming the data files and, if asked for, packing them into one file
+         */
+
+        WriteDataFileChecksums(std::string(argv[1]) + ".checksums", GetDataFiles(argv[1]));
+        if(write_dataset_container) {
+            WriteDatasetContainer(argv[1]);
+        }
         SimpleLogger().Write() << "finished preprocessing";
     } catch ( const std::exception &e ) {
         SimpleLogger().Write(logWARNING) <<
@@ -0,0 +1,290 @@
+/*
+    open source routing machine
+    Copyright (C) Dennis Luxen, 2010
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU AFFERO General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+or see http://www.gnu.org/licenses/agpl.txt.
+ */
+
+// Loads a dataset once into named shared memory, so that any number of
+// osrm-routed processes with SharedMemory=1 attach to it instead of loading
+// their own copy. A new dataset goes into the region that is not being
+// served; processes attached to the old one keep it mapped until they detach.
+
+#include "DataStructures/NameTable.h"
+#include "DataStructures/NodeInformationHelpDesk.h"
+#include "DataStructures/StaticRTree.h"
+#include "Server/DataStructures/QueryObjectsStorage.h"
+#include "Server/DataStructures/SharedDataLayout.h"
+#include "Util/DataFileChecksums.h"
+#include "Util/FileLoader.h"
+#include "Util/GraphLoader.h"
+#include "Util/IniFile.h"
+#include "Util/InputFileUtil.h"
+#include "Util/OSRMException.h"
+#include "Util/SimpleLogger.h"
+#include "Util/StringUtil.h"
+#include "Util/UUID.h"
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef QueryObjectsStorage::QueryGraph QueryGraph;
+typedef StaticRTree<RTreeLeaf> RTree;
+
+static std::string GetDataPath(
+    IniFile & serverConfig,
+    const std::string & key,
+    const boost::filesystem::path & base_path
+) {
+    if( !serverConfig.Holds(key) ) {
+        throw OSRMException(("no " + key + " file name in server ini").c_str());
+    }
+    return boost::filesystem::absolute(
+        serverConfig.GetParameter(key),
+        base_path
+    ).string();
+}
+
+//the loader returns the number of node entries including the sentinel
+static void LoadGraph(
+    const std::string & hsgr_path,
+    std::vector<QueryGraph::_StrNode> & node_list,
+    std::vector<QueryGraph::_StrEdge> & edge_list,
+    unsigned * number_of_nodes,
+    unsigned * check_sum
+) {
+    *number_of_nodes = readHSGRFromStream(hsgr_path, node_list, edge_list, check_sum);
+    node_list.resize(*number_of_nodes);
+}
+
+template<typename T>
+static void CopyBlock(
+    const T * data,
+    const SharedDataLayout & layout,
+    const SharedDataLayout::BlockID block,
+    char * region_begin
+) {
+    if( 0 < layout.block_size[block] ) {
+        std::memcpy(
+            layout.GetBlockPointer<T>(region_begin, block),
+            data,
+            layout.block_size[block]
+        );
+    }
+}
+
+template<typename T>
+static void CopyBlock(
+    const std::vector<T> & data,
+    const SharedDataLayout & layout,
+    const SharedDataLayout::BlockID block,
+    char * region_begin
+) {
+    BOOST_ASSERT(data.size() == layout.number_of_entries[block]);
+    CopyBlock(data.empty() ? NULL : &data[0], layout, block, region_begin);
+}
+
+static void CopyString(
+    const std::string & data,
+    const SharedDataLayout & layout,
+    const SharedDataLayout::BlockID block,
+    char * region_begin
+) {
+    std::copy(
+        data.begin(),
+        data.end(),
+        layout.GetBlockPointer<char>(region_begin, block)
+    );
+}
+
+int main (int argc, char * argv[]) {
+    try {
+        LogPolicy::GetInstance().Unmute();
+        const char * server_ini_path = (argc > 1 ? argv[1] : "server.ini");
+        if( !testDataFile(server_ini_path) ) {
+            std::string error_message = std::string(server_ini_path) + " not found";
+            throw OSRMException(error_message.c_str());
+        }
+        IniFile serverConfig(server_ini_path);
+        const boost::filesystem::path base_path =
+            boost::filesystem::absolute(server_ini_path).parent_path();
+
+        const std::string hsgr_path = GetDataPath(serverConfig, "hsgrData", base_path);
+        const std::string ram_index_path = GetDataPath(serverConfig, "ramIndex", base_path);
+        const std::string file_index_path = GetDataPath(serverConfig, "fileIndex", base_path);
+        const std::string nodes_path = GetDataPath(serverConfig, "nodesData", base_path);
+        const std::string edges_path = GetDataPath(serverConfig, "edgesData", base_path);
+        const std::string names_path = GetDataPath(serverConfig, "namesData", base_path);
+        std::string timestamp_path;
+        if( serverConfig.Holds("timestamp") ) {
+            timestamp_path = GetDataPath(serverConfig, "timestamp", base_path);
+        }
+        std::string grid_index_path;
+        if( serverConfig.Holds("gridIndex") ) {
+            grid_index_path = GetDataPath(serverConfig, "gridIndex", base_path);
+        }
+
+        //a damaged file must not replace the dataset that is being served
+        if( serverConfig.Holds("verifyDataFiles") &&
+            0 != stringToInt(serverConfig.GetParameter("verifyDataFiles"))
+        ) {
+            std::vector<std::string> data_files;
+            data_files.push_back(hsgr_path);
+            data_files.push_back(ram_index_path);
+            data_files.push_back(file_index_path);
+            data_files.push_back(nodes_path);
+            data_files.push_back(edges_path);
+            data_files.push_back(names_path);
+            if( !timestamp_path.empty() ) {
+                data_files.push_back(timestamp_path);
+            }
+            if( !grid_index_path.empty() ) {
+                data_files.push_back(grid_index_path);
+            }
+            VerifyDataFiles(GetDataPath(serverConfig, "checksums", base_path), data_files);
+        }
+
+        //the files are independent and read at the same time
+        ConcurrentLoader loader;
+        std::vector<QueryGraph::_StrNode> node_list;
+        std::vector<QueryGraph::_StrEdge> edge_list;
+        unsigned number_of_nodes = 0;
+        unsigned check_sum = 0;
+        loader.Add(
+            "graph",
+            boost::bind(
+                &LoadGraph,
+                hsgr_path,
+                boost::ref(node_list),
+                boost::ref(edge_list),
+                &number_of_nodes,
+                &check_sum
+            )
+        );
+        std::vector<NodeInformationHelpDesk::OriginalEdgeRecord> edge_records;
+        loader.Add(
+            "edge records",
+            boost::bind(
+                &NodeInformationHelpDesk::LoadEdgeRecords,
+                nodes_path,
+                edges_path,
+                boost::ref(edge_records)
+            )
+        );
+        std::vector<RTree::SearchTreeNode> search_tree;
+        std::vector<uint64_t> leaf_offsets;
+        loader.Add(
+            "search tree",
+            boost::bind(
+                &RTree::LoadSearchTree,
+                ram_index_path,
+                boost::ref(search_tree),
+                boost::ref(leaf_offsets)
+            )
+        );
+        NameTable names;
+        loader.Add("names", boost::bind(&NameTable::Load, &names, names_path));
+        loader.Run();
+
+        std::string timestamp;
+        QueryObjectsStorage::LoadTimestamp(timestamp_path, timestamp);
+
+        SharedDataLayout layout;
+        layout.check_sum = check_sum;
+        layout.number_of_nodes = number_of_nodes;
+        layout.SetBlockSize<QueryGraph::_StrNode>(SharedDataLayout::GRAPH_NODES, node_list.size());
+        layout.SetBlockSize<QueryGraph::_StrEdge>(SharedDataLayout::GRAPH_EDGES, edge_list.size());
+        layout.SetBlockSize<NodeInformationHelpDesk::OriginalEdgeRecord>(
+            SharedDataLayout::EDGE_RECORDS,
+            edge_records.size()
+        );
+        layout.SetBlockSize<RTree::SearchTreeNode>(SharedDataLayout::RTREE_NODES, search_tree.size());
+        layout.SetBlockSize<uint64_t>(SharedDataLayout::RTREE_LEAF_OFFSETS, leaf_offsets.size());
+        layout.SetBlockSize<uint32_t>(SharedDataLayout::NAME_OFFSETS, names.GetNumberOfNames() + 1);
+        layout.SetBlockSize<char>(SharedDataLayout::NAME_CHARACTERS, names.GetNumberOfCharacters());
+        layout.SetBlockSize<char>(SharedDataLayout::TIMESTAMP, timestamp.size());
+        layout.SetBlockSize<char>(SharedDataLayout::RTREE_LEAF_FILENAME, file_index_path.size());
+        layout.SetBlockSize<char>(SharedDataLayout::GRID_INDEX_FILENAME, grid_index_path.size());
+
+        //never overwrite the region that routed processes attach to
+        SharedDataControl control;
+        unsigned target_region = 0;
+        uint64_t generation = 0;
+        if( SharedDataRegion::ReadControl(control) ) {
+            target_region = (control.current_region + 1) % NUMBER_OF_SHARED_DATA_REGIONS;
+            generation = control.generation;
+        }
+        const std::string region_name = GetSharedDataRegionName(target_region);
+        SimpleLogger().Write() << "writing " << layout.GetRegionSize() <<
+            " bytes to " << region_name;
+
+        //processes still mapping an older dataset in this region keep it
+        boost::interprocess::shared_memory_object::remove(region_name.c_str());
+        boost::interprocess::shared_memory_object region_object(
+            boost::interprocess::create_only,
+            region_name.c_str(),
+            boost::interprocess::read_write
+        );
+        region_object.truncate(layout.GetRegionSize());
+        boost::interprocess::mapped_region region(
+            region_object,
+            boost::interprocess::read_write
+        );
+        char * region_begin = static_cast<char *>(region.get_address());
+        std::memcpy(region_begin, &layout, sizeof(SharedDataLayout));
+        CopyBlock(node_list, layout, SharedDataLayout::GRAPH_NODES, region_begin);
+        CopyBlock(edge_list, layout, SharedDataLayout::GRAPH_EDGES, region_begin);
+        CopyBlock(edge_records, layout, SharedDataLayout::EDGE_RECORDS, region_begin);
+        CopyBlock(search_tree, layout, SharedDataLayout::RTREE_NODES, region_begin);
+        CopyBlock(leaf_offsets, layout, SharedDataLayout::RTREE_LEAF_OFFSETS, region_begin);
+        CopyBlock(names.GetOffsets(), layout, SharedDataLayout::NAME_OFFSETS, region_begin);
+        CopyBlock(names.GetCharacters(), layout, SharedDataLayout::NAME_CHARACTERS, region_begin);
+        CopyString(timestamp, layout, SharedDataLayout::TIMESTAMP, region_begin);
+        CopyString(file_index_path, layout, SharedDataLayout::RTREE_LEAF_FILENAME, region_begin);
+        CopyString(grid_index_path, layout, SharedDataLayout::GRID_INDEX_FILENAME, region_begin);
+        region.flush();
+
+        //publish the region, processes attaching from now on get the new data
+        boost::interprocess::shared_memory_object control_object(
+            boost::interprocess::open_or_create,
+            SHARED_DATA_CONTROL_NAME,
+            boost::interprocess::read_write
+        );
+        control_object.truncate(sizeof(SharedDataControl));
+        boost::interprocess::mapped_region control_region(
+            control_object,
+            boost::interprocess::read_write
+        );
+        SharedDataRegion::PublishControl(
+            static_cast<SharedDataControl *>(control_region.get_address()),
+            target_region,
+            generation + 1
+        );
+
+        SimpleLogger().Write() << "published " << region_name <<
+            ", generation " << generation + 1;
+    } catch (const std::exception & e) {
+        SimpleLogger().Write(logWARNING) << "[exception] " << e.what();
+        return 1;
+    }
+    return 0;
+}
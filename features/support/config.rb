@@ -22,6 +22,7 @@ nodesData=#{@osm_file}.osrm.nodes
 edgesData=#{@osm_file}.osrm.edges
 ramIndex=#{@osm_file}.osrm.ramIndex
 fileIndex=#{@osm_file}.osrm.fileIndex
+gridIndex=#{@osm_file}.osrm.gridIndex
 namesData=#{@osm_file}.osrm.names
 timestamp=#{@osm_file}.osrm.timestamp
 EOF
@@ -23,6 +23,8 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include "Server/ServerFactory.h"
 
+#include "Util/AsyncLogger.h"
+#include "Util/FileLoader.h"
 #include "Util/IniFile.h"
 #include "Util/InputFileUtil.h"
 #include "Util/OpenMPWrapper.h"
@@ -36,11 +38,17 @@ or see http://www.gnu.org/licenses/agpl.txt.
 
 #include <signal.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/date_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #ifdef _WIN32
 boost::function0<void> console_ctrl_function;
@@ -61,12 +69,90 @@ BOOL WINAPI console_ctrl_handler(DWORD ctrl_type)
 }
 #endif
 
+#ifndef _WIN32
+static void ReloadRoutingMachines(const std::vector<OSRM *> & routing_machines) {
+    for( unsigned i = 0; i < routing_machines.size(); ++i ) {
+        routing_machines[i]->Reload();
+    }
+}
+#endif
+
+static void LoadRoutingMachine(const std::string & ini_path, OSRM ** routing_machine) {
+    *routing_machine = new OSRM(ini_path.c_str());
+}
+
+//Parses a list like "car:car.ini,foot:foot.ini" of profiles and the ini
+//files of their data sets, which are loaded at the same time. Without a
+//list the data set of the server ini is the only, unnamed profile.
+static void LoadRoutingMachines(
+    IniFile & serverConfig,
+    const std::string & server_ini_path,
+    std::vector<std::string> & profiles,
+    std::vector<OSRM *> & routing_machines
+) {
+    std::vector<std::string> ini_paths;
+    const std::string profile_list = serverConfig.GetParameter("Profiles");
+    std::vector<std::string> tokens;
+    boost::algorithm::split(tokens, profile_list, boost::algorithm::is_any_of(","));
+    const boost::filesystem::path base_path =
+        boost::filesystem::absolute(server_ini_path).parent_path();
+    BOOST_FOREACH(std::string & token, tokens) {
+        boost::algorithm::trim(token);
+        if( token.empty() ) {
+            continue;
+        }
+        const std::string::size_type colon = token.find(':');
+        if( std::string::npos == colon || 0 == colon || token.size() == colon+1 ) {
+            throw OSRMException("malformed profile " + token + ", expected name:ini");
+        }
+        const std::string profile = token.substr(0, colon);
+        //requests name the profile with letters only, see APIDecoder
+        if( !boost::algorithm::all(
+                profile,
+                boost::algorithm::is_from_range('a','z') ||
+                boost::algorithm::is_from_range('A','Z')
+            )
+        ) {
+            throw OSRMException("profile name " + profile + " may only contain the letters a-z and A-Z");
+        }
+        if( profiles.end() != std::find(profiles.begin(), profiles.end(), profile) ) {
+            throw OSRMException("profile " + profile + " is listed twice");
+        }
+        profiles.push_back(profile);
+        ini_paths.push_back(
+            boost::filesystem::absolute(token.substr(colon+1), base_path).string()
+        );
+    }
+    if( profiles.empty() ) {
+        profiles.push_back("");
+        ini_paths.push_back(server_ini_path);
+    }
+
+    routing_machines.assign(profiles.size(), NULL);
+    ConcurrentLoader loader;
+    for( unsigned i = 0; i < profiles.size(); ++i ) {
+        loader.Add(
+            profiles[i].empty() ? "data set" : "profile " + profiles[i],
+            boost::bind(&LoadRoutingMachine, ini_paths[i], &routing_machines[i])
+        );
+    }
+    try {
+        loader.Run();
+    } catch(...) {
+        for( unsigned i = 0; i < routing_machines.size(); ++i ) {
+            delete routing_machines[i];
+        }
+        routing_machines.clear();
+        throw;
+    }
+}
+
 int main (int argc, char * argv[]) {
     try {
         LogPolicy::GetInstance().Unmute();
 #ifdef __linux__
-        if(!mlockall(MCL_CURRENT | MCL_FUTURE)) {
-            SimpleLogger().Write(logWARNING) << "Process " << argv[0] << "could not be locked to RAM";
+        if(0 != mlockall(MCL_CURRENT | MCL_FUTURE)) {
+            SimpleLogger().Write(logWARNING) << "Process " << argv[0] << " could not be locked to RAM";
         }
 #endif
 #ifdef __linux__
@@ -94,11 +180,21 @@ int main (int argc, char * argv[]) {
         pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
 #endif
 
-        IniFile serverConfig((argc > 1 ? argv[1] : "server.ini"));
-        OSRM routing_machine((argc > 1 ? argv[1] : "server.ini"));
+        const char * server_ini_path = (argc > 1 ? argv[1] : "server.ini");
+        IniFile serverConfig(server_ini_path);
+        //the profiles share the server, its threads, buffers and metrics
+        std::vector<std::string> profiles;
+        std::vector<OSRM *> routing_machines;
+        LoadRoutingMachines(serverConfig, server_ini_path, profiles, routing_machines);
 
         Server * s = ServerFactory::CreateServer(serverConfig);
-        s->GetRequestHandlerPtr().RegisterRoutingMachine(&routing_machine);
+        for( unsigned i = 0; i < routing_machines.size(); ++i ) {
+            s->GetRequestHandlerPtr().RegisterRoutingMachine(routing_machines[i], profiles[i]);
+            if( !profiles[i].empty() ) {
+                SimpleLogger().Write() << "serving profile " << profiles[i] <<
+                    (0 == i ? " by default" : "");
+            }
+        }
 
         boost::thread t(boost::bind(&Server::Run, s));
 
@@ -109,9 +205,21 @@ int main (int argc, char * argv[]) {
         sigaddset(&wait_mask, SIGINT);
         sigaddset(&wait_mask, SIGQUIT);
         sigaddset(&wait_mask, SIGTERM);
+        sigaddset(&wait_mask, SIGHUP);
         pthread_sigmask(SIG_BLOCK, &wait_mask, 0);
         std::cout << "[server] running and waiting for requests" << std::endl;
-        sigwait(&wait_mask, &sig);
+        //SIGHUP reloads the data sets in the background, queries are
+        //answered and further signals handled meanwhile
+        boost::shared_ptr<boost::thread> reload_thread;
+        while( 0 == sigwait(&wait_mask, &sig) && SIGHUP == sig ) {
+            if( reload_thread && !reload_thread->timed_join(boost::posix_time::seconds(0)) ) {
+                SimpleLogger().Write(logWARNING) << "reload still running, ignoring SIGHUP";
+                continue;
+            }
+            reload_thread.reset(new boost::thread(
+                boost::bind(&ReloadRoutingMachines, boost::cref(routing_machines))
+            ));
+        }
 #else
         // Set console control handler to allow server to be stopped.
         console_ctrl_function = boost::bind(&Server::Stop, s);
@@ -122,6 +230,13 @@ int main (int argc, char * argv[]) {
 
         std::cout << "[server] initiating shutdown" << std::endl;
         s->Stop();
+#ifndef _WIN32
+        //the data sets must not be freed under a running reload
+        if( reload_thread && !reload_thread->timed_join(boost::posix_time::seconds(0)) ) {
+            std::cout << "[server] waiting for the running reload" << std::endl;
+            reload_thread->join();
+        }
+#endif
         std::cout << "[server] stopping threads" << std::endl;
 
         if(!t.timed_join(boost::posix_time::seconds(2))) {
@@ -130,6 +245,10 @@ int main (int argc, char * argv[]) {
 
         std::cout << "[server] freeing objects" << std::endl;
         delete s;
+        for( unsigned i = 0; i < routing_machines.size(); ++i ) {
+            delete routing_machines[i];
+        }
+        AsyncLogger::GetInstance().Stop();
         std::cout << "[server] shutdown completed" << std::endl;
     } catch (std::exception& e) {
         std::cerr << "[fatal error] exception: " << e.what() << std::endl;